@@ -0,0 +1,80 @@
+/*
+ * autocal_sim.cpp - Runs AutoCalibrator against a simulated counter
+ *
+ * An emulated Si5351 with a crystal that is off by a known amount drives
+ * CLK0 at the 14 MHz test frequency. Each gate counts the edges of the
+ * emulated output over the gate time, carrying the fractional edge over
+ * to the next gate like a free running PCNT unit, so the readings dither
+ * by one count exactly as on hardware. Prints every step and the final
+ * output error, and fails unless that is within the width the
+ * calibrator reports it can resolve.
+ *
+ *   g++ -std=c++17 -O2 -I include -I lib/Si5351Arduino-2.2.0/src \
+ *       lib/Si5351Arduino-2.2.0/src/si5351.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_batch.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_emu.cpp \
+ *       src/autocal.cpp extras/host/autocal_sim.cpp -o autocal_sim
+ *   ./autocal_sim [true_xtal_hz [gate_ms]]
+ *
+ * The default is a 25 MHz crystal that is 15 ppm high and 1 s (1PPS) gates.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "autocal.h"
+#include "si5351_emu.h"
+
+int main(int argc, char **argv)
+{
+  uint32_t trueXtal = 25000375;
+  uint32_t gateMs = 1000;
+  if (argc >= 2)
+    trueXtal = strtoul(argv[1], NULL, 10);
+  if (argc >= 3)
+    gateMs = strtoul(argv[2], NULL, 10);
+
+  Si5351Emulator emu(trueXtal);
+  Si5351 si5351(SI5351_BUS_BASE_ADDR, &emu);
+  if (!si5351.init(SI5351_CRYSTAL_LOAD_8PF, 25000000, 0))
+  {
+    printf("init failed\n");
+    return 1;
+  }
+  si5351.set_freq(AUTOCAL_TEST_FREQ, SI5351_CLK0);
+
+  AutoCalibrator cal(si5351);
+  cal.start(0);
+
+  srand(trueXtal);
+  double phase = (double)rand() / RAND_MAX; // Fraction of an edge carried between gates
+  uint32_t gate = 0;
+  uint8_t lastStep = cal.steps();
+  double nominal = (double)AUTOCAL_TEST_FREQ / SI5351_FREQ_MULT;
+
+  while (cal.isRunning() && gate < 500)
+  {
+    double edges = phase + emu.clk_freq(SI5351_CLK0) * gateMs / 1000.0;
+    uint32_t counts = (uint32_t)floor(edges);
+    phase = edges - counts;
+    gate++;
+
+    cal.addGate(counts, gateMs * 1000);
+    if (cal.steps() != lastStep)
+    {
+      lastStep = cal.steps();
+      printf("gate %3u  %-6s  counts %u  error %+7d ppb  -> correction %+d ppb\n",
+             gate, cal.state() == AutoCalState::Coarse ? "coarse" : "fine",
+             counts, cal.lastErrorPpb(), cal.correction());
+    }
+  }
+
+  double outErr = (emu.clk_freq(SI5351_CLK0) / nominal - 1.0) * 1e9;
+  double xtalPpb = ((double)trueXtal / 25000000.0 - 1.0) * 1e9;
+  printf("%s after %u gates (%.0f s): correction %+d ppb, crystal %+.1f ppb, output error %+.2f ppb (target %d ppb)\n",
+         cal.state() == AutoCalState::Done ? "done" : "FAILED", gate, gate * gateMs / 1000.0,
+         cal.correction(), xtalPpb, outErr, cal.targetPpb());
+
+  return cal.state() == AutoCalState::Done && fabs(outErr) <= cal.targetPpb() ? 0 : 1;
+}
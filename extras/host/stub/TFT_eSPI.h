@@ -0,0 +1,144 @@
+/*
+ * TFT_eSPI.h - Host stand-in for TFT_eSPI that counts SPI bytes
+ *
+ * Only what the widget layer calls. Instead of drawing, every primitive
+ * adds the bytes TFT_eSPI would clock out to an ILI9341 for it: an
+ * address window (CASET, RASET and RAMWR with their 8 parameter bytes,
+ * 11 bytes) per run, plus 2 bytes per RGB565 pixel. Rounded shapes and
+ * free font glyphs are broken into runs the way TFT_eSPI does it, so the
+ * totals track the real transfers to within a few percent.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+
+#define TFT_BLACK 0x0000
+#define TFT_NAVY 0x000F
+#define TFT_DARKGREEN 0x03E0
+#define TFT_MAROON 0x7800
+#define TFT_DARKGREY 0x7BEF
+#define TFT_BLUE 0x001F
+#define TFT_GREEN 0x07E0
+#define TFT_CYAN 0x07FF
+#define TFT_RED 0xF800
+#define TFT_YELLOW 0xFFE0
+#define TFT_WHITE 0xFFFF
+#define TFT_ORANGE 0xFDA0
+#define TFT_GOLD 0xFEA0
+
+#define TL_DATUM 0
+#define TC_DATUM 1
+#define MC_DATUM 4
+
+typedef struct
+{
+  uint16_t bitmapOffset;
+  uint8_t width, height;
+  uint8_t xAdvance;
+  int8_t xOffset, yOffset;
+} GFXglyph;
+
+typedef struct
+{
+  uint8_t *bitmap;
+  GFXglyph *glyph;
+  uint16_t first, last;
+  uint8_t yAdvance;
+} GFXfont;
+
+#define TFT_STUB_WINDOW_BYTES 11
+
+class TFT_eSPI
+{
+public:
+  uint64_t bytes = 0;
+  uint32_t windows = 0;
+
+  int16_t width() { return 320; }
+  int16_t height() { return 240; }
+
+  void fillScreen(uint32_t color) { fillRect(0, 0, 320, 240, color); }
+  void fillRect(int32_t, int32_t, int32_t w, int32_t h, uint32_t) { run((uint32_t)w * h); }
+  void drawFastHLine(int32_t, int32_t, int32_t w, uint32_t) { run(w); }
+  void drawFastVLine(int32_t, int32_t, int32_t h, uint32_t) { run(h); }
+
+  // Middle band, then one line per row of the two rounded ends
+  void fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint32_t color)
+  {
+    fillRect(x, y + r, w, h - 2 * r, color);
+    for (int32_t i = 0; i < 2 * r; i++)
+      run(w);
+  }
+
+  // Four straight edges, the arcs pixel by pixel
+  void drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint32_t color)
+  {
+    drawFastHLine(x + r, y, w - 2 * r, color);
+    drawFastHLine(x + r, y + h - 1, w - 2 * r, color);
+    drawFastVLine(x, y + r, h - 2 * r, color);
+    drawFastVLine(x + w - 1, y + r, h - 2 * r, color);
+    for (int32_t i = 0; i < (628 * r + 50) / 100; i++)
+      run(1);
+  }
+
+  void setFreeFont(const GFXfont *f) { font = f; }
+  void setTextFont(uint8_t) { font = nullptr; }
+  void setTextDatum(uint8_t) {}
+  void setTextColor(uint16_t, uint16_t = 0, bool = false) {}
+
+  // Free fonts draw only the set pixels, one line per horizontal run;
+  // built-in font 2 pushes each 8x16 cell with its background
+  int16_t drawString(const char *s, int32_t, int32_t)
+  {
+    for (; *s; s++)
+    {
+      if (!font)
+      {
+        run(8 * 16);
+        continue;
+      }
+      uint8_t c = (uint8_t)*s;
+      if (c < font->first || c > font->last)
+        continue;
+      const GFXglyph &g = font->glyph[c - font->first];
+      const uint8_t *bits = font->bitmap + g.bitmapOffset;
+      uint32_t bit = 0;
+      for (uint8_t yy = 0; yy < g.height; yy++)
+      {
+        uint32_t len = 0;
+        for (uint8_t xx = 0; xx < g.width; xx++, bit++)
+        {
+          if (bits[bit >> 3] & (0x80 >> (bit & 7)))
+            len++;
+          else if (len)
+          {
+            run(len);
+            len = 0;
+          }
+        }
+        if (len)
+          run(len);
+      }
+    }
+    return 0;
+  }
+
+  void reset()
+  {
+    bytes = 0;
+    windows = 0;
+  }
+
+private:
+  void run(uint32_t pixels)
+  {
+    bytes += TFT_STUB_WINDOW_BYTES + 2 * pixels;
+    windows++;
+  }
+
+  const GFXfont *font = nullptr;
+};
@@ -0,0 +1,155 @@
+/*
+ * ui_bench.cpp - SPI bytes per band selection, full redraw vs widgets
+ *
+ * Builds the band selection page with the widget layer on a TFT_eSPI
+ * stand-in that counts the bytes an ILI9341 would receive (see
+ * extras/host/stub/TFT_eSPI.h). It compares two ways of handling a band
+ * tap. The old one repainted the whole page and all ten buttons. The
+ * retained one recolours the two buttons whose selection changed.
+ *
+ * It then times WidgetScreen::hitTest() against the linear scan over the
+ * layout table the touch handlers used to do, and checks that both agree
+ * on every pixel of the screen.
+ *
+ *   g++ -std=c++17 -O2 -I extras/host/stub -I include \
+ *       src/widgets.cpp extras/host/ui_bench.cpp -o ui_bench
+ *   ./ui_bench
+ *
+ * Times assume the 27 MHz SPI clock set in platformio.ini.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include "widgets.h"
+#include "layout.h"
+#include "JetBrainsMono_Bold11pt7b.h"
+
+#define SPI_HZ 27000000.0
+
+static const uint64_t bandHz[] = {1836600, 3568600, 7038600, 10138700, 14095600,
+                                  18104600, 21094600, 24924600, 28124600, 50293000};
+#define BANDS 10
+
+static TFT_eSPI tft;
+static WidgetScreen ui(tft);
+static uint8_t buttons[BANDS];
+
+// Same layout and colours as drawBandButtons() in src/wip.cpp
+static void buildBandPage()
+{
+  ui.clear(TFT_BLACK);
+  for (int i = 0; i < BANDS; i++)
+  {
+    const LayoutItem &slot = bandLayout[i];
+    char mhz[24];
+    snprintf(mhz, sizeof(mhz), "%lu.%06lu", (unsigned long)(bandHz[i] / 1000000), (unsigned long)(bandHz[i] % 1000000));
+    buttons[i] = ui.addButton(slot.x, slot.y, slot.w, slot.h, 5, mhz, &JetBrainsMono_Bold11pt7b, TFT_WHITE, TFT_DARKGREY);
+    ui.setTouch(buttons[i], i);
+  }
+  ui.addLabel(0, 225, 320, 16, "Long Press to Exit", nullptr, TFT_WHITE);
+}
+
+static void select(int band)
+{
+  for (int i = 0; i < BANDS; i++)
+    ui.setColors(buttons[i], i == band ? TFT_BLACK : TFT_WHITE, i == band ? TFT_GREEN : TFT_DARKGREY);
+}
+
+// What the touch handlers did before: walk the table, test every rectangle
+static int16_t linearHit(const LayoutItem *table, size_t n, int16_t x, int16_t y)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    const LayoutItem &item = table[i];
+    if (x >= item.x && x < item.x + item.w && y >= item.y && y < item.y + item.h)
+      return i;
+  }
+  return -1;
+}
+
+// Checks every pixel, then times both lookups over the whole screen
+static void benchHits(const char *page, const LayoutItem *table, size_t n)
+{
+  ui.clear(TFT_BLACK);
+  for (size_t i = 0; i < n; i++)
+    ui.setTouch(ui.addButton(table[i].x, table[i].y, table[i].w, table[i].h, 5, "", nullptr, TFT_WHITE, TFT_DARKGREY), i);
+
+  int mismatches = 0;
+  for (int16_t y = 0; y < LAYOUT_SCREEN_H; y++)
+    for (int16_t x = 0; x < LAYOUT_SCREEN_W; x++)
+      if (ui.hitTest(x, y) != linearHit(table, n, x, y))
+        mismatches++;
+
+  const int rounds = 50;
+  volatile long sink = 0; // Keeps the loops from being optimised away
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++)
+    for (int16_t y = 0; y < LAYOUT_SCREEN_H; y++)
+      for (int16_t x = 0; x < LAYOUT_SCREEN_W; x++)
+        sink += linearHit(table, n, x, y);
+  auto t1 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++)
+    for (int16_t y = 0; y < LAYOUT_SCREEN_H; y++)
+      for (int16_t x = 0; x < LAYOUT_SCREEN_W; x++)
+        sink += ui.hitTest(x, y);
+  auto t2 = std::chrono::steady_clock::now();
+
+  double points = rounds * (double)LAYOUT_SCREEN_W * LAYOUT_SCREEN_H;
+  printf("%-12s %2zu targets  linear %6.2f ns  grid %6.2f ns  mismatches %d\n", page, n,
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / points,
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / points, mismatches);
+}
+
+static void report(const char *what, uint64_t bytes, uint32_t windows)
+{
+  printf("%-34s %8llu bytes %5u windows %7.2f ms\n", what, (unsigned long long)bytes, windows,
+         bytes * 8.0 / SPI_HZ * 1000.0);
+}
+
+int main()
+{
+  // Old behaviour: every tap rebuilt and repainted the page
+  uint64_t fullBytes = 0;
+  uint32_t fullWindows = 0;
+  for (int tap = 0; tap < BANDS; tap++)
+  {
+    buildBandPage();
+    select(tap);
+    tft.reset();
+    ui.render();
+    fullBytes += tft.bytes;
+    fullWindows += tft.windows;
+  }
+
+  // Retained: build once, then only the selection changes
+  buildBandPage();
+  select(-1);
+  ui.render();
+  uint64_t retainedBytes = 0;
+  uint32_t retainedWindows = 0;
+  for (int tap = 0; tap < BANDS; tap++)
+  {
+    select(tap);
+    tft.reset();
+    ui.render();
+    retainedBytes += tft.bytes;
+    retainedWindows += tft.windows;
+  }
+
+  // Tapping the selected band again changes nothing
+  tft.reset();
+  select(BANDS - 1);
+  ui.render();
+
+  report("full redraw per band tap", fullBytes / BANDS, fullWindows / BANDS);
+  report("retained widgets per band tap", retainedBytes / BANDS, retainedWindows / BANDS);
+  report("retained, same band again", tft.bytes, tft.windows);
+  printf("reduction %.1fx\n\n", (double)fullBytes / retainedBytes);
+
+  benchHits("main", mainLayout, LAYOUT_COUNT(mainLayout));
+  benchHits("bands", bandLayout, LAYOUT_COUNT(bandLayout));
+  benchHits("calibration", calibrationLayout, LAYOUT_COUNT(calibrationLayout));
+  benchHits("keypad", keypadLayout, LAYOUT_COUNT(keypadLayout));
+  return 0;
+}
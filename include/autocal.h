@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <si5351.h>
+
+#define AUTOCAL_TEST_FREQ (14000000ULL * SI5351_FREQ_MULT) // Same 14 MHz as the manual calibration page
+#define AUTOCAL_MAX_OFFSET_PPB 100000 // Anything further off is a wiring problem, not a crystal
+#define AUTOCAL_COARSE_ROUNDS 4
+#define AUTOCAL_FINE_GATES 8     // Gates averaged per bisection step
+#define AUTOCAL_SETTLE_GATES 1   // Gates thrown away after each correction change
+#define AUTOCAL_TARGET_PPB 2     // Narrowest bracket ever asked for; the counter usually sets a wider one
+#define AUTOCAL_MAX_STEPS 40     // Corrections tried before giving up on noisy readings
+
+enum class AutoCalState
+{
+  Idle,
+  Coarse,
+  Fine,
+  Done,
+  Failed
+};
+
+// Finds the Si5351 correction from frequency counter readings.
+//
+// The caller keeps a known test frequency on an output that is wired to
+// a counter, and feeds every completed gate (counts seen over gateUs)
+// to addGate(). The coarse phase applies the measured offset directly
+// until it is within a couple of counts of resolution. The fine phase
+// then bisects a bracket around it, averaging AUTOCAL_FINE_GATES gates
+// per step so the counter's +-1 count dither is averaged down. Each step
+// goes through set_correction(), which retunes without a PLL reset.
+//
+// Averaging only gets so far: one count at 14 MHz over a 1 s gate is
+// about 72 ppb, and AUTOCAL_FINE_GATES gates of independent dither
+// bring that down by sqrt(AUTOCAL_FINE_GATES), to about 26 ppb. The
+// bisection stops at that width (never below AUTOCAL_TARGET_PPB), and
+// targetPpb() reports it. A zero reading narrows the bracket to one
+// count around the correction rather than onto it, and a reading that
+// puts the answer outside the bracket widens it, so one noisy sign is
+// recovered instead of excluding the answer for good.
+//
+// No hardware access beyond the Si5351, so it runs unchanged against
+// simulated counts on a host.
+class AutoCalibrator
+{
+public:
+  AutoCalibrator(Si5351 &synth, enum si5351_pll_input ref = SI5351_PLL_INPUT_XO, uint64_t testFreq = AUTOCAL_TEST_FREQ);
+
+  void start(int32_t startPpb);
+  void abort();
+  AutoCalState addGate(uint32_t counts, uint32_t gateUs);
+
+  AutoCalState state() const { return calState; }
+  bool isRunning() const { return calState == AutoCalState::Coarse || calState == AutoCalState::Fine; }
+  int32_t correction() const { return current; }
+  int32_t lastErrorPpb() const { return lastError; }
+  uint8_t steps() const { return stepCount; }
+  int32_t targetPpb() const { return target; }
+
+private:
+  void apply(int32_t ppb);
+  void startFine(int32_t resolutionPpb);
+
+  Si5351 &si5351;
+  enum si5351_pll_input refOsc;
+  uint64_t freq;
+  AutoCalState calState = AutoCalState::Idle;
+  int32_t current = 0;
+  int32_t lastError = 0;
+  int32_t lo = 0;
+  int32_t hi = 0;
+  int32_t target = AUTOCAL_TARGET_PPB;
+  uint8_t settle = 0;
+  uint8_t gates = 0;
+  uint8_t stepCount = 0;
+  uint64_t sumCounts = 0;
+  uint64_t sumGateUs = 0;
+};
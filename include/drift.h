@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include <si5351.h>
+
+#define DRIFT_MAX_POINTS 16
+#define DRIFT_UPDATE_INTERVAL_MS 2000 // Minimum time between two correction steps
+#define DRIFT_MAX_STEP_PPB 10         // ~0.14 Hz at 14 MHz per step, well inside a WSPR bin
+#define DRIFT_DEADBAND_PPB 2
+#define DRIFT_BIAS_WEIGHT 0.25f // Share of each reference measurement folded into the bias
+
+// Tracks crystal drift and keeps the Si5351 correction following it.
+//
+// The correction is the static calibration value plus a drift model
+// ppb(T) = c0 + c1 * dT + c2 * dT^2, fitted by least squares to
+// (temperature, offset) calibration points, plus a bias that reference
+// measurements without a temperature pull towards the measured offset.
+// update() walks the applied correction towards that target in small,
+// rate-limited steps through Si5351::trim_correction(), which never
+// resets a PLL, so the output does not glitch. All offsets are in ppb
+// and use the same sign as set_correction().
+//
+// Temperatures are whatever the caller measures with, in degrees C. The
+// model only needs the same source for its points and its lookups, so a
+// sensor that reads a fixed amount off the crystal still works.
+class DriftCompensator
+{
+public:
+  DriftCompensator(Si5351 &synth, enum si5351_pll_input ref = SI5351_PLL_INPUT_XO);
+
+  void setBaseCorrection(int32_t ppb);
+  void rebaseCorrection(int32_t ppb);
+  void setTemperature(float tempC);
+  bool addCalibrationPoint(float tempC, int32_t offsetPpb);
+  void addReferenceMeasurement(int32_t offsetPpb);
+  void clearModel();
+  bool update(uint32_t nowMs);
+
+  int32_t targetCorrection() const;
+  int32_t appliedCorrection() const { return applied; }
+  uint8_t pointCount() const { return pointTotal; }
+
+private:
+  bool fitModel();
+  float modelPpb() const;
+
+  Si5351 &si5351;
+  enum si5351_pll_input refOsc;
+  int32_t base = 0;
+  int32_t applied = 0;
+  float temperature = NAN;
+  float biasPpb = 0.0f;
+  float coeff[3] = {0.0f, 0.0f, 0.0f};
+  float refTemp = 0.0f;
+  float pointTemp[DRIFT_MAX_POINTS];
+  int32_t pointPpb[DRIFT_MAX_POINTS];
+  uint8_t pointNext = 0;
+  uint8_t pointTotal = 0;
+  uint32_t lastUpdateMs = 0;
+  bool updated = false;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include <driver/pcnt.h>
+
+#define FREQCOUNTER_INPUT_PIN 34 // CLK output fed back through a series resistor
+#define FREQCOUNTER_PPS_PIN 35   // GPS 1PPS, -1 to gate on the ESP32 clock instead
+#define FREQCOUNTER_UNIT PCNT_UNIT_0
+#define FREQCOUNTER_H_LIM 30000      // Counter wraps here and bumps the overflow count
+#define FREQCOUNTER_LONG_GATE_MS 10000
+
+// Counts edges of a signal on a PCNT unit over a gate.
+//
+// With a 1PPS input the gate is one GPS second: the PPS interrupt
+// snapshots the running count straight from the PCNT register, so the
+// gate is as accurate as the GPS. Without one, poll() closes a software
+// gate of FREQCOUNTER_LONG_GATE_MS timed by esp_timer; that calibrates
+// against the ESP32's own crystal and is only as good as it (tens of
+// ppm), so prefer a 1PPS input whenever one is available.
+class FrequencyCounter
+{
+public:
+  FrequencyCounter(int inputPin = FREQCOUNTER_INPUT_PIN, int ppsPin = FREQCOUNTER_PPS_PIN);
+
+  bool begin(uint32_t longGateMs = FREQCOUNTER_LONG_GATE_MS);
+  void end();
+  bool poll(uint32_t *counts, uint32_t *gateUs);
+
+  bool usesPps() const { return ppsPin >= 0; }
+  bool isRunning() const { return running; }
+
+private:
+  static void IRAM_ATTR onOverflow(void *arg);
+  static void IRAM_ATTR onPps(void *arg);
+  uint32_t IRAM_ATTR total() const;
+
+  int inputPin;
+  int ppsPin;
+  uint32_t longGateUs = 0;
+  bool running = false;
+  volatile uint32_t overflows = 0;
+  volatile uint32_t ppsCount = 0;
+  volatile uint32_t ppsPrevCount = 0;
+  volatile int64_t ppsUs = 0;
+  volatile int64_t ppsPrevUs = 0;
+  volatile uint32_t ppsEdges = 0;
+  uint32_t ppsEdgesSeen = 0;
+  uint32_t gateStartCount = 0;
+  int64_t gateStartUs = 0;
+};
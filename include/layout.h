@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+#define LAYOUT_SCREEN_W 320 // Landscape, setRotation(3)
+#define LAYOUT_SCREEN_H 240
+#define LAYOUT_BAND_SLOTS 10
+
+// What a touch on a layout item does
+enum class UiAction : uint8_t
+{
+  Page,    // arg: page to open
+  Band,    // arg: index into bands[]
+  Correct, // arg: correction step in ppb
+  Return,
+  AutoCal,
+  Key      // arg: key character, 'C' clears, 'K' is OK
+};
+
+// One touch target. The draw*Page() functions build their widgets from
+// these tables and register each one with its table index, so the touch
+// handlers get that index back from WidgetScreen::hitTest() and never
+// repeat a coordinate.
+struct LayoutItem
+{
+  int16_t x, y, w, h;
+  const char *label; // nullptr when the page fills it in (band frequencies)
+  UiAction action;
+  int16_t arg;
+};
+
+// Main menu: three page buttons and the About... line below them
+constexpr LayoutItem mainLayout[] = {
+    {60, 58, 200, 40, "WSPR Freqs", UiAction::Page, 1},
+    {60, 109, 200, 40, "Calibration", UiAction::Page, 2},
+    {60, 160, 200, 40, "Manual Entry", UiAction::Page, 3},
+    {80, 210, 160, 26, "About...", UiAction::Page, 4}};
+
+// Band selection: two columns of five
+constexpr LayoutItem bandSlot(int i)
+{
+  return {(int16_t)(i < 5 ? 15 : 165), (int16_t)((i % 5) * (34 + 11) + 2), 132, 34, nullptr, UiAction::Band, (int16_t)i};
+}
+
+constexpr LayoutItem bandLayout[LAYOUT_BAND_SLOTS] = {
+    bandSlot(0), bandSlot(1), bandSlot(2), bandSlot(3), bandSlot(4),
+    bandSlot(5), bandSlot(6), bandSlot(7), bandSlot(8), bandSlot(9)};
+
+// Calibration: six correction steps, smallest in the middle, then Auto
+// and Return along the bottom. The arrows move the output frequency, so
+// the left ones add ppb (a higher assumed crystal frequency lowers CLK0)
+constexpr LayoutItem calibrationLayout[] = {
+    {3, 140, 48, 35, "<<<", UiAction::Correct, +1000},
+    {56, 140, 48, 35, "<<", UiAction::Correct, +100},
+    {109, 140, 48, 35, "<", UiAction::Correct, +10},
+    {162, 140, 48, 35, ">", UiAction::Correct, -10},
+    {215, 140, 48, 35, ">>", UiAction::Correct, -100},
+    {268, 140, 48, 35, ">>>", UiAction::Correct, -1000},
+    {10, 196, 80, 34, "Auto", UiAction::AutoCal, 0},
+    {100, 196, 120, 34, "Return", UiAction::Return, 0}};
+
+// Frequency entry keypad, 3 x 4 under the display
+constexpr LayoutItem keypadLayout[] = {
+    {34, 50, 77, 40, "1", UiAction::Key, '1'},
+    {121, 50, 77, 40, "2", UiAction::Key, '2'},
+    {208, 50, 77, 40, "3", UiAction::Key, '3'},
+    {34, 100, 77, 40, "4", UiAction::Key, '4'},
+    {121, 100, 77, 40, "5", UiAction::Key, '5'},
+    {208, 100, 77, 40, "6", UiAction::Key, '6'},
+    {34, 150, 77, 40, "7", UiAction::Key, '7'},
+    {121, 150, 77, 40, "8", UiAction::Key, '8'},
+    {208, 150, 77, 40, "9", UiAction::Key, '9'},
+    {34, 200, 77, 40, "C", UiAction::Key, 'C'},
+    {121, 200, 77, 40, "0", UiAction::Key, '0'},
+    {208, 200, 77, 40, "OK", UiAction::Key, 'K'}};
+
+#define LAYOUT_COUNT(table) (sizeof(table) / sizeof(table[0]))
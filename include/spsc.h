@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+
+// Fixed size ring buffer for one producer task and one consumer task.
+//
+// push() and pop() never block and take no lock, so they are safe across
+// the two ESP32 cores without a critical section: the producer only
+// writes head, the consumer only writes tail, and the release/acquire
+// pair on them orders the slot contents. push() fails when full and
+// pop() when empty; the caller decides what that means. N must be a
+// power of two.
+template <typename T, size_t N>
+class SpscQueue
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+  bool push(const T &item)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N)
+      return false;
+    slots[h & (N - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t)
+      return false;
+    item = slots[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+private:
+  T slots[N];
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+};
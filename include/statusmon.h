@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include <si5351.h>
+#include <si5351_async.h>
+
+#define STATUSMON_PERIOD_MS 250 // Poll rate, 2 small I2C reads per poll
+#define STATUSMON_STACK_SIZE 2048
+#define STATUSMON_PRIORITY 1    // Below the I2C task so retunes go first
+
+// Event bits, same positions as in the status and sticky registers
+#define STATUSMON_SYS_INIT 0x80
+#define STATUSMON_LOL_B 0x40
+#define STATUSMON_LOL_A 0x20
+#define STATUSMON_EVENTS (STATUSMON_SYS_INIT | STATUSMON_LOL_B | STATUSMON_LOL_A)
+
+struct StatusCounters
+{
+  uint32_t polls;
+  uint32_t readErrors;
+  uint32_t lolA;    // Loss of lock events on PLL A
+  uint32_t lolB;
+  uint32_t sysInit; // Device resets seen, registers were lost
+};
+
+// Watches the Si5351 lock and reset flags from a background task.
+//
+// Every period the task reads the device status register and the sticky
+// interrupt register behind it through the async bus, so the reads queue
+// up behind pending writes and nothing on the UI side ever waits. A flag
+// raised in either counts as one event: the live bit catches a lasting
+// loss, the sticky bit one that came and went between polls. Seen sticky
+// bits are cleared again. Events collect in a bit set for the main loop
+// to take with takeEvents(); status() and counters() are snapshots.
+class StatusMonitor
+{
+public:
+  StatusMonitor(Si5351AsyncBus &bus, uint8_t devAddr = SI5351_BUS_BASE_ADDR);
+
+  bool begin(uint32_t periodMs = STATUSMON_PERIOD_MS);
+  void end();
+  void setPeriod(uint32_t periodMs);
+  uint32_t period() const { return periodMs; }
+  bool isRunning() const { return task != nullptr; }
+
+  uint8_t status() const { return lastStatus; }
+  bool locked(enum si5351_pll pll) const;
+  uint8_t takeEvents();
+  StatusCounters counters() const;
+  void resetCounters();
+
+private:
+  static void taskMain(void *arg);
+  void poll();
+
+  Si5351AsyncBus &bus;
+  uint8_t devAddr;
+  volatile uint32_t periodMs = STATUSMON_PERIOD_MS;
+  TaskHandle_t task = nullptr;
+  volatile bool stopping = false;
+  volatile uint8_t lastStatus = 0;
+  uint8_t events = 0;
+  StatusCounters counts = {};
+};
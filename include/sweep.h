@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+#include <si5351.h>
+#include <si5351_async.h>
+
+#define SWEEP_MAX_STEPS 4096
+#define SWEEP_BUS_HZ 100000 // I2C clock of the Si5351 bus; wip.cpp sets Wire to it
+#define SWEEP_STEP_BITS ((2 + SI5351_PARAMETERS_LENGTH) * 9 + 2) // Address, register and 8 data bytes with acks, start, stop
+#define SWEEP_MIN_DWELL_US (SWEEP_STEP_BITS * 1000000UL / SWEEP_BUS_HZ * 5 / 4) // A full step write plus a quarter for wakeups, 1150 us at 100 kHz
+#define SWEEP_TIMER_NUM 1   // Timer 0 belongs to the WSPR transmitter
+
+// Steps one Si5351 output from a start to a stop frequency.
+//
+// configure() locks the PLL once and solves the multisynth register image
+// of every step up front (8 bytes each), so a step at run time is a single
+// bulk write with no PLL reset. A hardware timer paces the steps, but its
+// interrupt only counts them and notifies the task that owns the Si5351.
+// That task calls service() when it wakes and writes the step that is
+// due, so sweep writes never interleave with its own. Steps it was too
+// late for are skipped and counted in missedSteps().
+//
+// With a Si5351AsyncBus a write only queues the step, so each one is
+// followed by a fence and achievedStepRate() is timed from when the
+// fences come back, i.e. from the bus, not from the queue. The dwell
+// cannot be shorter than SWEEP_MIN_DWELL_US, the bus time of one full
+// step write, and a sweep has 2 to SWEEP_MAX_STEPS steps; configure()
+// rejects anything else. Frequencies are in Hz * 100, as in the Si5351
+// library.
+class SweepEngine
+{
+public:
+  SweepEngine(Si5351 &synth, Si5351AsyncBus *bus = nullptr, enum si5351_clock clk = SI5351_CLK0);
+  ~SweepEngine();
+
+  bool configure(uint64_t startFreq, uint64_t stopFreq, uint32_t steps, uint32_t dwellUs);
+  bool start(TaskHandle_t owner, bool repeat = false);
+  bool service();
+  void stop();
+
+  bool isActive() const { return active; }
+  uint16_t stepIndex() const { return step; }
+  uint16_t stepCount() const { return steps; }
+  uint64_t stepFreq(uint16_t step) const;
+  float achievedStepRate() const;
+  uint32_t missedSteps() const { return missed; }
+  uint32_t failedSteps() const { return failed; }
+  uint32_t planTimeUs() const { return planUs; }
+
+private:
+  static void IRAM_ATTR onStepTimer();
+  static void onStepWritten(uint8_t status, void *arg);
+  bool writeStep(uint16_t index);
+
+  Si5351 &si5351;
+  Si5351AsyncBus *asyncBus;
+  enum si5351_clock clock;
+  uint8_t (*stepImage)[SI5351_PARAMETERS_LENGTH] = nullptr;
+  uint64_t startFreq = 0;
+  uint64_t stopFreq = 0;
+  uint16_t steps = 0;
+  uint32_t dwellUs = 0;
+  uint32_t planUs = 0;
+  bool repeat = false;
+  volatile bool active = false;
+  volatile uint32_t ticks = 0; // Timer edges since start(), counted by the interrupt
+  uint32_t ticksServed = 0;
+  uint16_t step = 0;
+  uint32_t missed = 0;
+  volatile uint32_t failed = 0;
+  volatile uint32_t stepsDone = 0; // Confirmed by the bus
+  volatile int64_t firstDoneUs = 0;
+  volatile int64_t lastDoneUs = 0;
+  hw_timer_t *timer = nullptr;
+  TaskHandle_t ownerTask = nullptr;
+
+  static SweepEngine *instance;
+};
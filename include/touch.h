@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define TOUCH_IRQ_PIN -1          // XPT2046 PENIRQ, -1 when not wired
+#define TOUCH_SAMPLE_MS 10        // Sample rate while the panel is touched
+#define TOUCH_PRESS_SAMPLES 2     // Agreeing samples before a press counts
+#define TOUCH_RELEASE_SAMPLES 3   // Missed samples before a release counts
+#define TOUCH_LONG_MS 1000
+#define TOUCH_REPEAT_DELAY_MS 500 // First repeat, then every TOUCH_REPEAT_MS
+#define TOUCH_REPEAT_MS 150
+#define TOUCH_SLOP 12             // Pixels a tap may drift and still be a tap
+#define TOUCH_SWIPE_MIN 60        // Pixels of travel for a swipe
+#define TOUCH_SWIPE_MAX_MS 600
+#define TOUCH_QUEUE_LEN 8
+
+enum class TouchEventType : uint8_t
+{
+  Press,     // Finger down, after debouncing
+  Release,   // Finger up; tap is set if nothing else claimed the touch
+  LongPress, // Held still for TOUCH_LONG_MS, sent once
+  Repeat,    // Held still, sent every TOUCH_REPEAT_MS after a delay
+  Swipe      // Quick stroke, sent just before its Release
+};
+
+enum class TouchDir : uint8_t
+{
+  None,
+  Left,
+  Right,
+  Up,
+  Down
+};
+
+struct TouchEvent
+{
+  TouchEventType type;
+  int16_t x, y;           // Where the finger is (or was last seen)
+  int16_t startX, startY; // Where it went down, for hit-testing
+  uint32_t heldMs;
+  TouchDir dir;           // Swipe only
+  bool tap;               // Release only
+};
+
+// Reads one touch point in screen coordinates, false when not touched
+typedef bool (*TouchReader)(int16_t *x, int16_t *y);
+
+// Turns touch samples into press, release, long press, repeat and swipe
+// events.
+//
+// poll() is called from the UI loop on every pass and never waits. It takes a
+// sample only every TOUCH_SAMPLE_MS, and with PENIRQ wired only once the
+// pen interrupt has fired, so an untouched panel costs no SPI time. The
+// samples run through a small state machine that debounces contact,
+// times holds and measures strokes. Its events go into a queue that the
+// page handlers drain with next(). Sampling stays in the UI loop, on the
+// task that draws, because the touch controller shares the SPI bus with
+// the display.
+class TouchEngine
+{
+public:
+  TouchEngine(TouchReader reader, int irqPin = TOUCH_IRQ_PIN);
+
+  void begin();
+  void poll(uint32_t nowMs);
+  bool next(TouchEvent *ev);
+  void cancel();
+  bool touched() const { return state == State::Down || state == State::Ignore; }
+
+private:
+  enum class State : uint8_t
+  {
+    Up,
+    Pending, // Contact seen, not yet debounced
+    Down,
+    Ignore   // Cancelled, waiting for the finger to lift
+  };
+
+  static void IRAM_ATTR onPenIrq(void *arg);
+  void sample(uint32_t nowMs);
+  void emit(TouchEventType type, uint32_t nowMs, TouchDir dir = TouchDir::None, bool tap = false);
+
+  TouchReader reader;
+  int irqPin;
+  volatile bool penIrq = false;
+
+  State state = State::Up;
+  uint8_t hits = 0;
+  uint8_t misses = 0;
+  bool moved = false;
+  bool longSent = false;
+  uint32_t lastSampleMs = 0;
+  uint32_t downMs = 0;
+  uint32_t lastSeenMs = 0;
+  uint32_t nextRepeatMs = 0;
+  int16_t x = 0, y = 0;
+  int16_t startX = 0, startY = 0;
+
+  TouchEvent queue[TOUCH_QUEUE_LEN];
+  uint8_t head = 0;
+  uint8_t tail = 0;
+};
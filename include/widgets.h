@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <TFT_eSPI.h>
+
+#define WIDGET_MAX 24      // Most widgets on any one page (calibration page: 14)
+#define WIDGET_TEXT_LEN 32
+#define WIDGET_NONE 0xFF
+
+// Touch grid: 16 x 16 pixel cells over the 320x240 landscape screen, each
+// holding a bit set of the touchable widgets that overlap it
+#define WIDGET_GRID_SHIFT 4
+#define WIDGET_GRID_COLS (320 >> WIDGET_GRID_SHIFT)
+#define WIDGET_GRID_ROWS (240 >> WIDGET_GRID_SHIFT)
+static_assert(WIDGET_MAX <= 32, "Grid cells hold one bit per widget");
+
+enum class WidgetKind : uint8_t
+{
+  Button,
+  Label,
+  Readout
+};
+
+// One rectangle on screen. Text is always centred in it.
+struct Widget
+{
+  WidgetKind kind;
+  int16_t x, y, w, h;
+  uint8_t radius;         // Rounded corners, 0 for a plain rectangle
+  uint8_t frames;         // Nested 1-pixel frames, 0 for none
+  uint16_t fg, bg, frame; // Labels and readouts sit on the page colour
+  const GFXfont *font;    // nullptr selects built-in font 2
+  char text[WIDGET_TEXT_LEN];
+  int64_t value;          // Readouts: shown as prefix + 1'234'567 + suffix
+  const char *prefix;
+  const char *suffix;
+  int16_t tag;            // Returned by hitTest(), -1 when not touchable
+  bool dirty;
+};
+
+// Retained widgets for one page.
+//
+// A page adds its widgets once, after clear(). From then on, changes go
+// through setText(), setValue() and setColors(). These only mark a widget
+// dirty when something visible actually changes. render() repaints just
+// the dirty rectangles, so selecting a band touches two buttons instead
+// of the whole 320x240 screen. The full-screen fill happens only on the
+// first render() after clear().
+//
+// Widgets given a tag with setTouch() are entered into a coarse grid, so
+// hitTest() looks at one cell and the few widgets in it instead of
+// scanning the page.
+class WidgetScreen
+{
+public:
+  explicit WidgetScreen(TFT_eSPI &tft);
+
+  void clear(uint16_t pageBg);
+  void release();
+
+  uint8_t addButton(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t radius, const char *label,
+                    const GFXfont *font, uint16_t fg, uint16_t bg, uint8_t frames = 1);
+  uint8_t addLabel(int16_t x, int16_t y, int16_t w, int16_t h, const char *text, const GFXfont *font, uint16_t fg);
+  uint8_t addReadout(int16_t x, int16_t y, int16_t w, int16_t h, const char *prefix, int64_t value,
+                     const char *suffix, const GFXfont *font, uint16_t fg);
+
+  void setText(uint8_t id, const char *text);
+  void setValue(uint8_t id, int64_t value);
+  void setColors(uint8_t id, uint16_t fg, uint16_t bg);
+  void setFrame(uint8_t id, uint16_t frame, uint16_t bg, uint8_t radius, uint8_t frames);
+  void invalidate(uint8_t id);
+  void invalidateAll();
+
+  void setTouch(uint8_t id, int16_t tag);
+  int16_t hitTest(int16_t x, int16_t y) const;
+
+  bool render();
+
+  uint8_t count() const { return used; }
+  const Widget &widget(uint8_t id) const { return widgets[id]; }
+  uint16_t pageBackground() const { return pageBg; }
+
+private:
+  uint8_t add(WidgetKind kind, int16_t x, int16_t y, int16_t w, int16_t h, const GFXfont *font, uint16_t fg, uint16_t bg);
+  void formatValue(Widget &w);
+  void draw(const Widget &w);
+
+  TFT_eSPI &tft;
+  Widget widgets[WIDGET_MAX];
+  uint32_t grid[WIDGET_GRID_ROWS][WIDGET_GRID_COLS];
+  uint8_t used = 0;
+  uint16_t pageBg = TFT_BLACK;
+  bool fillPending = false;
+  bool owned = false;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+#include <si5351.h>
+
+// WSPR type 1 message: 162 symbols of 4-FSK, 12000/8192 Hz apart, 8192/12000 s each
+#define WSPR_SYMBOL_COUNT 162
+#define WSPR_TONE_COUNT 4
+#define WSPR_SYMBOL_PERIOD_US 682667      // 8192/12000 s, rounded (+54 us drift over a whole message)
+#define WSPR_TONE_SPACING_CHZ_NUM 1200000 // 12000/8192 Hz in Hz * 100, as NUM / DEN
+#define WSPR_TONE_SPACING_CHZ_DEN 8192
+#define WSPR_DEFAULT_AUDIO_OFFSET 1500 // Hz above the dial frequency, centre of the 200 Hz window
+#define WSPR_TIMER_NUM 0
+
+// Encodes a WSPR message and keys it on one Si5351 output.
+//
+// The four tone register images are solved once in prepare(), so each
+// symbol edge is a single multisynth bulk write with no PLL reset.
+// A hardware timer paces the symbols. Its interrupt only counts the edge
+// and notifies the task that owns the Si5351, which calls service() to
+// key the symbol that is due. Keying therefore never interleaves with
+// that task's other writes, such as drift trims, which touch only the
+// PLL. An edge the owner was late for still keys the symbol that is due
+// by then, so the message stays on time; the skipped ones are counted
+// in missedSymbols().
+class WSPRTransmitter
+{
+public:
+  WSPRTransmitter(Si5351 &synth, enum si5351_clock clk = SI5351_CLK0);
+
+  bool setMessage(const char *callsign, const char *locator, int8_t powerDbm);
+  bool prepare(uint64_t dialFreqHz, uint16_t audioOffsetHz = WSPR_DEFAULT_AUDIO_OFFSET);
+  bool start(TaskHandle_t owner);
+  bool service();
+  void stop();
+
+  bool isActive() const { return active; }
+  bool hasMessage() const { return messageReady; }
+  bool isReady() const { return messageReady && tonesReady; }
+  uint8_t symbolIndex() const { return symbol; }
+  const uint8_t *symbols() const { return symbolTable; }
+  uint8_t missedSymbols() const { return missed; }
+  uint8_t failedSymbols() const { return failed; }
+
+private:
+  static void IRAM_ATTR onSymbolTimer();
+  void keySymbol(uint8_t index);
+
+  Si5351 &si5351;
+  enum si5351_clock clock;
+  uint8_t symbolTable[WSPR_SYMBOL_COUNT];
+  uint8_t toneImage[WSPR_TONE_COUNT][SI5351_PARAMETERS_LENGTH];
+  bool messageReady = false;
+  bool tonesReady = false;
+  volatile bool active = false;
+  volatile uint8_t ticks = 0; // Symbol edges since start(), counted by the interrupt
+  uint8_t ticksServed = 0;
+  uint8_t symbol = 0;
+  uint8_t missed = 0;
+  uint8_t failed = 0;
+  hw_timer_t *timer = nullptr;
+  TaskHandle_t ownerTask = nullptr;
+
+  static WSPRTransmitter *instance;
+};
+
+bool wsprEncode(const char *callsign, const char *locator, int8_t powerDbm, uint8_t *symbols);
@@ -0,0 +1,128 @@
+/*
+ * alloc_bench.cpp - Host benchmark for heap use on the retune path
+ *
+ * Retunes the emulated device through set_freq(), set_freq_manual(),
+ * set_pll(), set_ms() and set_vcxo() with a counting global operator
+ * new, and reports the allocations and time per call. The register
+ * packing used to allocate on every PLL and multisynth write; it must
+ * not allocate at all now, and the program fails if anything does.
+ *
+ *   g++ -std=c++17 -O2 -I lib/Si5351Arduino-2.2.0/src \
+ *       lib/Si5351Arduino-2.2.0/src/si5351.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_batch.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_emu.cpp \
+ *       lib/Si5351Arduino-2.2.0/extras/host/alloc_bench.cpp -o alloc_bench
+ *   ./alloc_bench [retunes]
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "si5351.h"
+#include "si5351_emu.h"
+
+static volatile uint32_t allocations = 0;
+
+void *operator new(size_t size)
+{
+	allocations++;
+	void *p = malloc(size ? size : 1);
+	if(p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
+
+template <typename F>
+static bool measure(const char *name, uint32_t count, F call)
+{
+	uint32_t before = allocations;
+	auto t0 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < count; i++)
+	{
+		call(i);
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	uint32_t used = allocations - before;
+
+	double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / count;
+	printf("%-16s %8u calls, %6u allocations, %8.1f ns/call\n", name, count, used, ns);
+	return used == 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t count = 20000;
+
+	if(argc >= 2)
+	{
+		count = strtoul(argv[1], NULL, 10);
+	}
+
+	Si5351Emulator emu;
+	Si5351 si5351(SI5351_BUS_BASE_ADDR, &emu);
+
+	if(!si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0))
+	{
+		return 1;
+	}
+
+	// Alternate between two settings so every call changes registers
+	bool ok = true;
+	ok &= measure("set_freq", count, [&](uint32_t i) {
+		si5351.set_freq(i & 1 ? 1409560000ULL : 703860000ULL, SI5351_CLK0);
+	});
+	ok &= measure("set_freq_manual", count, [&](uint32_t i) {
+		si5351.set_freq_manual(i & 1 ? 1000000000ULL : 1250000000ULL, 75000000000ULL, SI5351_CLK1);
+	});
+	ok &= measure("set_pll", count, [&](uint32_t i) {
+		si5351.set_pll(i & 1 ? 80000000000ULL : 70000000000ULL, SI5351_PLLA);
+	});
+	ok &= measure("set_ms", count, [&](uint32_t i) {
+		struct Si5351RegSet ms_reg = {(uint32_t)(128 * (i & 1 ? 50 : 60) - 512), 0, 1};
+		si5351.set_ms(SI5351_CLK0, ms_reg, 1, SI5351_OUTPUT_CLK_DIV_1, 0);
+	});
+	ok &= measure("set_vcxo", count, [&](uint32_t i) {
+		si5351.set_vcxo(i & 1 ? 87000000000ULL : 86000000000ULL, 30);
+	});
+
+	if(!ok)
+	{
+		printf("FAILED: the retune path allocated\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * batch_bench.cpp - Host benchmark for si5351_plan_batch()
+ *
+ * Plans a million pseudo-random output frequencies between 8 kHz and
+ * 200 MHz with si5351_plan_batch() and with calc_plan_exact() called one
+ * at a time, checks that both agree, reports the throughput of each and
+ * how many candidates synthesize exactly, and spot checks results on the
+ * emulated device. -fno-trapping-math lets GCC vectorize the
+ * double to integer conversions in the first pass.
+ *
+ *   g++ -std=c++17 -O3 -march=native -fno-trapping-math -I lib/Si5351Arduino-2.2.0/src \
+ *       lib/Si5351Arduino-2.2.0/src/si5351.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_batch.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_emu.cpp \
+ *       lib/Si5351Arduino-2.2.0/extras/host/batch_bench.cpp -o batch_bench
+ *   ./batch_bench [count [correction_ppb]]
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "si5351.h"
+#include "si5351_batch.h"
+#include "si5351_emu.h"
+
+int main(int argc, char **argv)
+{
+	uint32_t count = 1000000;
+	int32_t correction = 0;
+
+	if(argc >= 2)
+	{
+		count = strtoul(argv[1], NULL, 10);
+	}
+	if(argc >= 3)
+	{
+		correction = strtol(argv[2], NULL, 10);
+	}
+
+	Si5351Emulator emu;
+	Si5351 si5351(SI5351_BUS_BASE_ADDR, &emu);
+
+	if(!si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, correction))
+	{
+		return 1;
+	}
+
+	uint64_t *freq = new uint64_t[count];
+	struct Si5351BatchResult *res = new struct Si5351BatchResult[count];
+	uint64_t lo = 8000ULL * SI5351_FREQ_MULT;
+	uint64_t hi = 200000000ULL * SI5351_FREQ_MULT;
+	uint64_t x = 0x9E3779B97F4A7C15ULL;
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		freq[i] = lo + x % (hi - lo);
+	}
+
+	// One call per candidate first, which also warms the caches
+	uint8_t *ret = new uint8_t[count];
+	int64_t *error = new int64_t[count];
+	uint8_t (*images)[2 * SI5351_PARAMETERS_LENGTH] = new uint8_t[count][2 * SI5351_PARAMETERS_LENGTH];
+	auto t0 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < count; i++)
+	{
+		struct Si5351FreqPlan plan;
+		ret[i] = si5351.calc_plan_exact(freq[i], SI5351_PLLA, &plan);
+		error[i] = plan.error;
+		memcpy(images[i], plan.pll_params, SI5351_PARAMETERS_LENGTH);
+		memcpy(images[i] + SI5351_PARAMETERS_LENGTH, plan.ms_params, SI5351_PARAMETERS_LENGTH);
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	uint32_t failed = si5351.calc_plan_batch(freq, count, SI5351_PLLA, res);
+	auto t2 = std::chrono::steady_clock::now();
+
+	uint32_t mismatch = 0, exact = 0;
+	double worst = 0.0;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(ret[i] != res[i].status || (ret[i] == 0 && (error[i] != res[i].error ||
+			memcmp(images[i], res[i].pll_params, SI5351_PARAMETERS_LENGTH) != 0 ||
+			memcmp(images[i] + SI5351_PARAMETERS_LENGTH, res[i].ms_params, SI5351_PARAMETERS_LENGTH) != 0)))
+		{
+			mismatch++;
+		}
+		if(res[i].status == 0)
+		{
+			exact += (res[i].error == 0);
+			worst = fmax(worst, fabs((double)res[i].error));
+		}
+	}
+
+	// Write every 1000th result to the emulated device
+	double worst_emu = 0.0;
+	si5351.set_freq(1000000000ULL, SI5351_CLK0);
+	for(uint32_t i = 0; i < count; i += 1000)
+	{
+		if(res[i].status != 0)
+		{
+			continue;
+		}
+		si5351.si5351_write_bulk(SI5351_PLLA_PARAMETERS, SI5351_PARAMETERS_LENGTH, res[i].pll_params);
+		si5351.si5351_write_bulk(SI5351_CLK0_PARAMETERS, SI5351_PARAMETERS_LENGTH, res[i].ms_params);
+		si5351.set_int(SI5351_CLK0, res[i].int_mode);
+		double want = (double)freq[i] / SI5351_FREQ_MULT;
+		double err = fabs(emu.clk_freq(SI5351_CLK0) * (1.0 + correction / 1e9) - want) / want;
+		worst_emu = fmax(worst_emu, err);
+	}
+
+	double single_us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+	double batch_us = std::chrono::duration<double, std::micro>(t2 - t1).count();
+	printf("%u candidates, correction %ld ppb\n", count, (long)correction);
+	printf("batch:  %.0f ms, %.1f ns/candidate\n", batch_us / 1000.0, batch_us * 1000.0 / count);
+	printf("single: %.0f ms, %.1f ns/candidate\n", single_us / 1000.0, single_us * 1000.0 / count);
+	printf("%u failed, %u mismatched, %u exact (%.2f %%), worst error %.3f uHz\n",
+		failed, mismatch, exact, 100.0 * exact / count, worst);
+	printf("emulated spot check: worst relative error %.3g\n", worst_emu);
+
+	delete[] freq;
+	delete[] res;
+	delete[] ret;
+	delete[] error;
+	delete[] images;
+	return mismatch != 0;
+}
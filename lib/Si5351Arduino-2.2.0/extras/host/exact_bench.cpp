@@ -0,0 +1,236 @@
+/*
+ * exact_bench.cpp - Host benchmark for calc_plan_exact()
+ *
+ * Plans pseudo-random output frequencies between 8 kHz and 225 MHz
+ * (with sub-hertz parts) one at a time, and reports the solve time, the
+ * worst error below and above 112 MHz and how many plans needed a
+ * fractional multisynth. A second set sits just off simple fractions
+ * p/q of the reference, the worst case for the PLL fraction, both below
+ * and above 112 MHz, and also reports the slowest single solve. Every plan is decoded again by
+ * si5351_plan_check(). A few known hard frequencies are listed on their
+ * own and checked on the emulated device.
+ *
+ *   g++ -std=c++17 -O2 -I lib/Si5351Arduino-2.2.0/src \
+ *       lib/Si5351Arduino-2.2.0/src/si5351.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_batch.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_emu.cpp \
+ *       lib/Si5351Arduino-2.2.0/extras/host/exact_bench.cpp -o exact_bench
+ *   ./exact_bench [count [correction_ppb]]
+ *
+ * Exits non-zero if a plan fails its check, a frequency below 112 MHz
+ * ends up more than SI5351_FRAC_MS_MIN_ERROR off or one above it more
+ * than the 3 Hz documented for si5351_plan_exact().
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "si5351.h"
+#include "si5351_calc.h"
+#include "si5351_emu.h"
+
+// Highest output that still leaves room for a fractional multisynth
+#define FRAC_MS_LIMIT (112000000ULL * SI5351_FREQ_MULT)
+#define HIGH_MAX_ERROR 3000000LL // Documented bound above FRAC_MS_LIMIT, about half a PLL step / 4
+
+static const uint64_t hard_freqs[] = {
+	14861111200ULL,		// 148611112 Hz, multisynth 6 or 7 only
+	15208333400ULL,		// 152083334 Hz, DIVBY4, VCO 1/3 off a multiple of 25 MHz
+	19375000110ULL,		// 193750001.10 Hz, DIVBY4, VCO 4.4 Hz above 31 * 25 MHz
+	9000000029ULL,		// 90000000.29 Hz
+	1409560000ULL,		// 14095600 Hz, 20 m WSPR
+	702400000ULL,		// 7024000 Hz
+	1000000ULL		// 10 kHz
+};
+
+struct NearResult
+{
+	uint32_t count;
+	uint32_t failed;
+	uint32_t bad;
+	uint32_t over;
+	int64_t worst;
+	uint64_t worst_freq;
+	double total_us;
+	double slowest_us;
+};
+
+// Plans ref * p / q + offset for every q up to 32 and every offset whose
+// fraction lands in [lo, hi)
+static void near_pq(Si5351 &si5351, uint64_t ref, uint64_t lo, uint64_t hi,
+	const uint64_t *offsets, uint32_t offset_count, struct NearResult *res)
+{
+	for(uint64_t q = 1; q <= 32; q++)
+	{
+		for(uint64_t p = lo * q / ref; ref * p / q < hi; p++)
+		{
+			for(uint32_t k = 0; k < offset_count; k++)
+			{
+				uint64_t f = ref * p / q + offsets[k];
+				if(f < lo || f >= hi)
+				{
+					continue;
+				}
+
+				struct Si5351FreqPlan plan;
+				auto s0 = std::chrono::steady_clock::now();
+				res->failed += si5351.calc_plan_exact(f, SI5351_PLLA, &plan);
+				auto s1 = std::chrono::steady_clock::now();
+				double t = std::chrono::duration<double, std::micro>(s1 - s0).count();
+				int64_t err = plan.error < 0 ? -plan.error : plan.error;
+
+				res->total_us += t;
+				res->slowest_us = t > res->slowest_us ? t : res->slowest_us;
+				res->count++;
+				res->bad += si5351_plan_check(plan, ref) ? 0 : 1;
+				res->over += err > SI5351_FRAC_MS_MIN_ERROR;
+				if(err > res->worst)
+				{
+					res->worst = err;
+					res->worst_freq = f;
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t count = 200000;
+	int32_t correction = 0;
+	int ret = 0;
+
+	if(argc >= 2)
+	{
+		count = strtoul(argv[1], NULL, 10);
+	}
+	if(argc >= 3)
+	{
+		correction = strtol(argv[2], NULL, 10);
+	}
+
+	Si5351Emulator emu;
+	Si5351 si5351(SI5351_BUS_BASE_ADDR, &emu);
+
+	if(!si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, correction))
+	{
+		return 1;
+	}
+	uint64_t ref = si5351_correct_ref(SI5351_XTAL_FREQ * SI5351_FREQ_MULT, correction);
+
+	printf("%u candidates, correction %ld ppb\n", count, (long)correction);
+	printf("%16s %14s %6s %8s %12s\n", "target Hz", "error uHz", "class", "check", "device Hz");
+	for(uint32_t i = 0; i < sizeof(hard_freqs) / sizeof(hard_freqs[0]); i++)
+	{
+		struct Si5351FreqPlan plan;
+		if(si5351.calc_plan_exact(hard_freqs[i], SI5351_PLLA, &plan) != 0)
+		{
+			printf("%16.2f no plan\n", hard_freqs[i] / (double)SI5351_FREQ_MULT);
+			ret = 1;
+			continue;
+		}
+		bool ok = si5351_plan_check(plan, ref);
+		si5351.set_freq_plan(&plan, SI5351_CLK0);
+		double device = emu.clk_freq(SI5351_CLK0) * (1.0 + correction / 1e9);
+		printf("%16.2f %14lld %6d %8s %12.4f\n", hard_freqs[i] / (double)SI5351_FREQ_MULT,
+			(long long)plan.error, (int)plan.jitter_class, ok ? "ok" : "FAILED", device);
+		ret |= ok ? 0 : 1;
+	}
+
+	uint64_t *freq = new uint64_t[count];
+	struct Si5351FreqPlan *plans = new struct Si5351FreqPlan[count];
+	uint64_t lo = 8000ULL * SI5351_FREQ_MULT;
+	uint64_t hi = SI5351_MULTISYNTH_MAX_FREQ * SI5351_FREQ_MULT;
+	uint64_t x = 0x9E3779B97F4A7C15ULL;
+
+	// Log-uniform, so every octave gets the same share
+	for(uint32_t i = 0; i < count; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		double u = (double)(x >> 11) / 9007199254740992.0;
+		freq[i] = (uint64_t)(lo * pow((double)hi / lo, u));
+	}
+
+	uint32_t failed = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < count; i++)
+	{
+		failed += si5351.calc_plan_exact(freq[i], SI5351_PLLA, &plans[i]);
+	}
+	auto t1 = std::chrono::steady_clock::now();
+
+	uint32_t bad = 0, frac = 0, exact = 0, over = 0;
+	int64_t worst_lo = 0, worst_hi = 0;
+	uint64_t worst_lo_freq = 0, worst_hi_freq = 0;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const struct Si5351FreqPlan &plan = plans[i];
+		int64_t err = plan.error < 0 ? -plan.error : plan.error;
+
+		bad += si5351_plan_check(plan, ref) ? 0 : 1;
+		frac += plan.jitter_class == SI5351_JITTER_FRACTIONAL_MS;
+		exact += err == 0;
+		if(plan.freq < FRAC_MS_LIMIT)
+		{
+			over += err > SI5351_FRAC_MS_MIN_ERROR;
+			if(err > worst_lo)
+			{
+				worst_lo = err;
+				worst_lo_freq = plan.freq;
+			}
+		}
+		else if(err > worst_hi)
+		{
+			worst_hi = err;
+			worst_hi_freq = plan.freq;
+		}
+	}
+
+	double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+	printf("solve: %.0f ms, %.2f us/candidate\n", us / 1000.0, us / count);
+	printf("%u failed, %u failed check, %u exact (%.2f %%), %u fractional multisynth (%.2f %%)\n",
+		failed, bad, exact, 100.0 * exact / count, frac, 100.0 * frac / count);
+	printf("below 112 MHz: worst %lld uHz at %.2f Hz, %u over %lld uHz\n",
+		(long long)worst_lo, worst_lo_freq / (double)SI5351_FREQ_MULT, over, (long long)SI5351_FRAC_MS_MIN_ERROR);
+	printf("above 112 MHz: worst %lld uHz at %.2f Hz\n",
+		(long long)worst_hi, worst_hi_freq / (double)SI5351_FREQ_MULT);
+
+	// Just off ref * p / q, q up to 32, the worst case for the PLL
+	// fraction. Below 112 MHz a few sub-hertz offsets; above it, where
+	// the 20-bit PLL fraction alone sets the output, offsets out to where
+	// the next representable fraction is nearer again
+	static const uint64_t offsets_lo[] = {1, 7, 29, 50};
+	static const uint64_t offsets_hi[] = {1, 7, 29, 50, 110, 150, 200, 250, 280, 298, 320, 400, 500};
+	struct NearResult near_lo = {}, near_hi = {};
+	near_pq(si5351, ref, 100000ULL * SI5351_FREQ_MULT, FRAC_MS_LIMIT,
+		offsets_lo, sizeof(offsets_lo) / sizeof(offsets_lo[0]), &near_lo);
+	near_pq(si5351, ref, FRAC_MS_LIMIT, SI5351_MULTISYNTH_MAX_FREQ * SI5351_FREQ_MULT,
+		offsets_hi, sizeof(offsets_hi) / sizeof(offsets_hi[0]), &near_hi);
+	failed += near_lo.failed + near_hi.failed;
+	bad += near_lo.bad + near_hi.bad;
+	over += near_lo.over;
+	printf("near p/q below 112 MHz: %u candidates, %.2f us/candidate, slowest %.1f us, worst %lld uHz at %.2f Hz\n",
+		near_lo.count, near_lo.total_us / near_lo.count, near_lo.slowest_us,
+		(long long)near_lo.worst, near_lo.worst_freq / (double)SI5351_FREQ_MULT);
+	printf("near p/q above 112 MHz: %u candidates, %.2f us/candidate, slowest %.1f us, worst %lld uHz at %.2f Hz\n",
+		near_hi.count, near_hi.total_us / near_hi.count, near_hi.slowest_us,
+		(long long)near_hi.worst, near_hi.worst_freq / (double)SI5351_FREQ_MULT);
+	if(near_hi.worst > HIGH_MAX_ERROR || worst_hi > HIGH_MAX_ERROR)
+	{
+		printf("FAILED: above 112 MHz over the documented %lld uHz\n", (long long)HIGH_MAX_ERROR);
+		ret = 1;
+	}
+
+	delete[] freq;
+	delete[] plans;
+	return ret || failed != 0 || bad != 0 || over != 0;
+}
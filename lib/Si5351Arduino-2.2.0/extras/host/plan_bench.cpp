@@ -0,0 +1,97 @@
+/*
+ * plan_bench.cpp - Host benchmark for sweep plan generation
+ *
+ * Solves the multisynth register images of a 10000 point sweep the same
+ * way the sweep engine does (one exact PLL plan for the highest step,
+ * then calc_ms_image() for every step) and reports the time per point
+ * and the worst frequency error seen on the emulated device.
+ *
+ *   g++ -std=c++17 -O2 -I lib/Si5351Arduino-2.2.0/src \
+ *       lib/Si5351Arduino-2.2.0/src/si5351.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_batch.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_emu.cpp \
+ *       lib/Si5351Arduino-2.2.0/extras/host/plan_bench.cpp -o plan_bench
+ *   ./plan_bench [start_hz stop_hz points]
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "si5351.h"
+#include "si5351_emu.h"
+
+int main(int argc, char **argv)
+{
+	uint64_t start = 1000000ULL * SI5351_FREQ_MULT;
+	uint64_t stop = 100000000ULL * SI5351_FREQ_MULT;
+	uint32_t points = 10000;
+
+	if(argc == 4)
+	{
+		start = strtoull(argv[1], NULL, 10) * SI5351_FREQ_MULT;
+		stop = strtoull(argv[2], NULL, 10) * SI5351_FREQ_MULT;
+		points = strtoul(argv[3], NULL, 10);
+	}
+	if(points < 2 || start >= stop)
+	{
+		fprintf(stderr, "need start < stop and at least 2 points\n");
+		return 1;
+	}
+
+	Si5351Emulator emu;
+	Si5351 si5351(SI5351_BUS_BASE_ADDR, &emu);
+	struct Si5351FreqPlan plan;
+
+	if(!si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0))
+	{
+		return 1;
+	}
+	if(si5351.calc_plan_exact(stop, SI5351_PLLA, &plan) != 0 || si5351.set_freq_plan(&plan, SI5351_CLK0) != 0)
+	{
+		fprintf(stderr, "no PLL plan for %llu Hz\n", (unsigned long long)(stop / SI5351_FREQ_MULT));
+		return 1;
+	}
+
+	uint8_t (*images)[SI5351_PARAMETERS_LENGTH] = new uint8_t[points][SI5351_PARAMETERS_LENGTH];
+	uint64_t span = stop - start;
+
+	auto t0 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < points; i++)
+	{
+		uint64_t freq = start + (span * i + (points - 1) / 2) / (points - 1);
+		if(si5351.calc_ms_image(freq, SI5351_PLLA, images[i], NULL) != 0)
+		{
+			fprintf(stderr, "step %u (%llu Hz) out of range\n", i, (unsigned long long)(freq / SI5351_FREQ_MULT));
+			return 1;
+		}
+	}
+	auto t1 = std::chrono::steady_clock::now();
+
+	// Check every image on the emulated device
+	double worst = 0.0;
+	for(uint32_t i = 0; i < points; i++)
+	{
+		uint64_t freq = start + (span * i + (points - 1) / 2) / (points - 1);
+		si5351.si5351_write_bulk(SI5351_CLK0_PARAMETERS, SI5351_PARAMETERS_LENGTH, images[i]);
+		double err = fabs(emu.clk_freq(SI5351_CLK0) - (double)freq / SI5351_FREQ_MULT);
+		if(err > worst)
+		{
+			worst = err;
+		}
+	}
+
+	double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+	printf("%u points, %.0f us total, %.3f us/point, %u bytes of images\n",
+		points, us, us / points, (unsigned)(points * SI5351_PARAMETERS_LENGTH));
+	printf("worst error %.6f Hz\n", worst);
+
+	delete[] images;
+	return 0;
+}
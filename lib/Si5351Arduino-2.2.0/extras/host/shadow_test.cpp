@@ -0,0 +1,180 @@
+/*
+ * shadow_test.cpp - Host test for the register shadow
+ *
+ * Cycles CLK0 through the WSPR bands on the emulated device the way the
+ * firmware originally changed band (set_freq(), drive_strength(),
+ * output_enable()), once with the register shadow working normally and
+ * once with it dropped before every call, which is how the driver
+ * talked to the bus before it had a shadow: every read-modify-write
+ * reads the device and every register is sent whether it changed or
+ * not. Writes are batched by transactions in both runs, so the
+ * difference is the shadow's alone. Reports the bus
+ * transactions and bytes of each run and fails unless the shadow cuts
+ * the transactions at least threefold with the same outputs.
+ *
+ * It then retunes inside a transaction on a bus whose error count moves
+ * halfway through, the way a deferred write failure shows up, and fails
+ * unless the commit still sends every staged register and the PLL reset.
+ *
+ *   g++ -std=c++17 -O2 -I lib/Si5351Arduino-2.2.0/src \
+ *       lib/Si5351Arduino-2.2.0/src/si5351.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_batch.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_emu.cpp \
+ *       lib/Si5351Arduino-2.2.0/extras/host/shadow_test.cpp -o shadow_test
+ *   ./shadow_test
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "si5351.h"
+#include "si5351_emu.h"
+
+#define MIN_REDUCTION 3.0
+
+static const uint64_t bands[] = {
+	183660000ULL, 356860000ULL, 703860000ULL, 1013870000ULL, 1409560000ULL,
+	1810460000ULL, 2109460000ULL, 2492460000ULL, 2812460000ULL, 5029300000ULL
+};
+
+#define BAND_COUNT (sizeof(bands) / sizeof(bands[0]))
+#define ROUNDS 10
+
+struct Traffic
+{
+	uint32_t transactions;
+	uint32_t bytes;
+	double clk0[BAND_COUNT];
+};
+
+static bool run(bool shadow, struct Traffic *traffic)
+{
+	Si5351Emulator emu;
+	Si5351 si5351(SI5351_BUS_BASE_ADDR, &emu);
+
+	if(!si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0))
+	{
+		return false;
+	}
+	si5351.set_freq(bands[0], SI5351_CLK0);
+	emu.reset_counters();
+
+	for(uint32_t round = 0; round < ROUNDS; round++)
+	{
+		for(uint32_t i = 0; i < BAND_COUNT; i++)
+		{
+			// The firmware's original band change, each call as it would
+			// have gone without a shadow. Its update_status() is left out:
+			// status registers always go to the device, and StatusMonitor
+			// polls them now
+			if(!shadow)
+			{
+				si5351.invalidate_shadow();
+			}
+			si5351.set_freq(bands[i], SI5351_CLK0);
+			if(!shadow)
+			{
+				si5351.invalidate_shadow();
+			}
+			si5351.drive_strength(SI5351_CLK0, SI5351_DRIVE_8MA);
+			if(!shadow)
+			{
+				si5351.invalidate_shadow();
+			}
+			si5351.output_enable(SI5351_CLK0, 1);
+			traffic->clk0[i] = emu.clk_freq(SI5351_CLK0);
+		}
+	}
+
+	traffic->transactions = emu.write_transactions + emu.read_transactions;
+	traffic->bytes = emu.bytes_written;
+	return true;
+}
+
+// Emulated device behind a bus that reports write failures after the
+// fact, like Si5351AsyncBus
+class LateErrorBus : public Si5351Emulator
+{
+public:
+	uint32_t error_count(void) { return errors; }
+	uint32_t errors = 0;
+};
+
+// Stages a band change, lets the error count move after the first
+// register is staged and before the reads the rest of the change does,
+// and checks what reached the device
+static bool staged_survives_error(uint64_t from, uint64_t to)
+{
+	LateErrorBus bus;
+	Si5351 si5351(SI5351_BUS_BASE_ADDR, &bus);
+	struct Si5351FreqPlan plan;
+	struct Si5351OutputState out = {1, SI5351_DRIVE_8MA, 0, 1, SI5351_CLK_SRC_MS, SI5351_CLK_DISABLE_LOW};
+
+	if(!si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0) ||
+		si5351.set_freq(from, SI5351_CLK0) != 0 ||
+		si5351.calc_plan_exact(to, SI5351_PLLA, &plan) != 0)
+	{
+		return false;
+	}
+	uint32_t resets = bus.pll_resets[SI5351_PLLA];
+
+	si5351.begin_transaction();
+	si5351.set_freq_plan(&plan, SI5351_CLK0);
+	bus.errors++;
+	si5351.set_output_state(SI5351_CLK0, &out);
+	si5351.commit();
+
+	double want = (double)plan.actual_freq / SI5351_FREQ_MULT;
+	double got = bus.clk_freq(SI5351_CLK0);
+	bool reset = bus.pll_resets[SI5351_PLLA] != resets;
+	printf("error mid-transaction: CLK0 %.6f Hz (want %.6f), PLL reset %s\n", got, want, reset ? "sent" : "LOST");
+	return fabs(got - want) < 1e-3 && reset;
+}
+
+int main(void)
+{
+	struct Traffic with = {}, without = {};
+
+	if(!run(true, &with) || !run(false, &without))
+	{
+		fprintf(stderr, "init failed\n");
+		return 1;
+	}
+
+	uint32_t retunes = ROUNDS * BAND_COUNT;
+	double reduction = (double)without.transactions / with.transactions;
+	printf("%u retunes\n", retunes);
+	printf("no shadow: %u transactions (%.1f per retune), %u bytes written\n",
+		without.transactions, (double)without.transactions / retunes, without.bytes);
+	printf("shadow:    %u transactions (%.1f per retune), %u bytes written\n",
+		with.transactions, (double)with.transactions / retunes, with.bytes);
+	printf("%.2fx fewer transactions\n", reduction);
+
+	int ret = 0;
+	for(uint32_t i = 0; i < BAND_COUNT; i++)
+	{
+		if(fabs(with.clk0[i] - without.clk0[i]) > 1e-6)
+		{
+			printf("band %u: %.6f Hz with shadow, %.6f Hz without\n", i, with.clk0[i], without.clk0[i]);
+			ret = 1;
+		}
+	}
+	if(reduction < MIN_REDUCTION)
+	{
+		printf("FAILED: expected at least %.0fx\n", MIN_REDUCTION);
+		ret = 1;
+	}
+
+	if(!staged_survives_error(bands[0], bands[4]))
+	{
+		printf("FAILED: staged registers lost to a bus error seen mid-transaction\n");
+		ret = 1;
+	}
+
+	return ret;
+}
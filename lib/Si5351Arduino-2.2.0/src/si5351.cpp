@@ -23,25 +23,49 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#ifdef ARDUINO
 #include "Arduino.h"
 #include "Wire.h"
+#endif
 #include "si5351.h"
+#include "si5351_calc.h"
+#include "si5351_batch.h"
+
+#ifdef ARDUINO
+static Si5351WireBus default_wire_bus(Wire);
+#endif
 
 
 /********************/
 /* Public functions */
 /********************/
 
-Si5351::Si5351(uint8_t i2c_addr):
-	i2c_bus_addr(i2c_addr)
+Si5351::Si5351(uint8_t i2c_addr, Si5351Bus *i2c_bus):
+	i2c_bus_addr(i2c_addr),
+	bus(i2c_bus)
 {
+#ifdef ARDUINO
+	if(bus == NULL)
+	{
+		bus = &default_wire_bus;
+	}
+#endif
+
 	xtal_freq[0] = SI5351_XTAL_FREQ;
 
 	// Start by using XO ref osc as default for each PLL
 	plla_ref_osc = SI5351_PLL_INPUT_XO;
 	pllb_ref_osc = SI5351_PLL_INPUT_XO;
 	clkin_div = SI5351_CLKIN_DIV_1;
+	txn_depth = 0;
+	pll_stale = 0;
+	bus_errors_seen = 0;
+
+	invalidate_shadow();
+	clear_plan_cache();
 }
 
 /*
@@ -57,27 +81,55 @@ Si5351::Si5351(uint8_t i2c_addr):
  * corr - Frequency correction constant in parts-per-billion
  *
  * Returns a boolean that indicates whether a device was found on the desired
- * I2C address.
+ * I2C address and finished its own initialization (SYS_INIT) within
+ * SI5351_SYS_INIT_TIMEOUT_MS.
  *
  */
 bool Si5351::init(uint8_t xtal_load_c, uint32_t xo_freq, int32_t corr)
 {
+	if(bus == NULL)
+	{
+		return false;
+	}
+
 	// Start I2C comms
-	Wire.begin();
+	bus->begin();
 
 	// Check for a device on the bus, bail out if it is not there
-	Wire.beginTransmission(i2c_bus_addr);
 	uint8_t reg_val;
-  reg_val = Wire.endTransmission();
+  reg_val = bus->probe(i2c_bus_addr);
 
 	if(reg_val == 0)
 	{
-		// Wait for SYS_INIT flag to be clear, indicating that device is ready
+		// Forget anything cached from a previous init, the device may have
+		// been power cycled in the meantime
+		bus_errors_seen = bus->error_count();
+		invalidate_shadow();
+
+		// Wait for SYS_INIT flag to be clear, indicating that device is ready.
+		// Give up after SI5351_SYS_INIT_TIMEOUT_MS rather than hang. A read
+		// that comes back short says nothing about SYS_INIT, so it counts
+		// as not ready yet
 		uint8_t status_reg = 0;
-		do
+		uint16_t polls = 0;
+		for(;;)
 		{
-			status_reg = si5351_read(SI5351_DEVICE_STATUS);
-		} while (status_reg >> 7 == 1);
+			if(bus_read_bulk(SI5351_DEVICE_STATUS, 1, &status_reg) == 1 &&
+				status_reg >> 7 == 0)
+			{
+				break;
+			}
+			if(++polls >= SI5351_SYS_INIT_TIMEOUT_MS)
+			{
+				return false;
+			}
+#ifdef ARDUINO
+			delay(1);
+#endif
+		}
+
+		// Mirror the register map so later read-modify-writes stay off the bus
+		sync_shadow();
 
 		// Set crystal load capacitance
 		si5351_write(SI5351_CRYSTAL_LOAD, (xtal_load_c & SI5351_CRYSTAL_LOAD_MASK) | 0b00010010);
@@ -108,6 +160,19 @@ bool Si5351::init(uint8_t xtal_load_c, uint32_t xo_freq, int32_t corr)
 	}
 }
 
+/*
+ * set_bus(Si5351Bus *i2c_bus)
+ *
+ * Select the transport used for all register access. Call before init().
+ * The register shadow is discarded since it described the old bus.
+ */
+void Si5351::set_bus(Si5351Bus *i2c_bus)
+{
+	bus = i2c_bus;
+	bus_errors_seen = bus == NULL ? 0 : bus->error_count();
+	invalidate_shadow();
+}
+
 /*
  * reset(void)
  *
@@ -190,6 +255,24 @@ void Si5351::reset(void)
  *   (use the si5351_clock enum)
  */
 uint8_t Si5351::set_freq(uint64_t freq, enum si5351_clock clk)
+{
+	uint8_t ret_val;
+
+	// Stage every register touched by this change and send them together
+	begin_transaction();
+	ret_val = stage_freq(freq, clk);
+	commit();
+
+	return ret_val;
+}
+
+/*
+ * stage_freq(uint64_t freq, enum si5351_clock clk)
+ *
+ * Frequency calculation behind set_freq(). Must be called inside a
+ * transaction so that the resulting register writes are coalesced.
+ */
+uint8_t Si5351::stage_freq(uint64_t freq, enum si5351_clock clk)
 {
 	struct Si5351RegSet ms_reg;
 	uint64_t pll_freq;
@@ -261,7 +344,7 @@ uint8_t Si5351::set_freq(uint64_t freq, enum si5351_clock clk)
 
 						// Select the proper R div value
 						temp_freq = clk_freq[i];
-						r_div = select_r_div(&temp_freq);
+						r_div = si5351_select_r_div(&temp_freq);
 
 						multisynth_calc(temp_freq, pll_freq, &temp_reg);
 
@@ -298,7 +381,7 @@ uint8_t Si5351::set_freq(uint64_t freq, enum si5351_clock clk)
 			}
 
 			// Select the proper R div value
-			r_div = select_r_div(&freq);
+			r_div = si5351_select_r_div(&freq);
 
 			// Calculate the synth parameters
 			if(pll_assignment[clk] == SI5351_PLLA)
@@ -471,6 +554,8 @@ uint8_t Si5351::set_freq_manual(uint64_t freq, uint64_t pll_freq, enum si5351_cl
 
 	uint8_t r_div;
 
+	begin_transaction();
+
 	clk_freq[(uint8_t)clk] = freq;
 
 	set_pll(pll_freq, pll_assignment[clk]);
@@ -479,7 +564,7 @@ uint8_t Si5351::set_freq_manual(uint64_t freq, uint64_t pll_freq, enum si5351_cl
 	output_enable(clk, 1);
 
 	// Select the proper R div value
-	r_div = select_r_div(&freq);
+	r_div = si5351_select_r_div(&freq);
 
 	// Calculate the synth parameters
 	multisynth_calc(freq, pll_freq, &ms_reg);
@@ -494,81 +579,765 @@ uint8_t Si5351::set_freq_manual(uint64_t freq, uint64_t pll_freq, enum si5351_cl
 	// Set multisynth registers (MS must be set before PLL)
 	set_ms(clk, ms_reg, int_mode, r_div, div_by_4);
 
+	commit();
+
     return 0;
 }
 
 /*
- * set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
+ * calc_plan_exact(uint64_t freq, enum si5351_pll target_pll, struct Si5351FreqPlan *plan)
  *
- * Set the specified PLL to a specific oscillation frequency
+ * Alternative to the fixed-denominator math in set_freq(). Searches
+ * every multisynth divider that keeps the VCO in range, pairs it with
+ * the best 20-bit rational PLL feedback ratio for the corrected
+ * reference, and keeps the pair with the smallest output error. Even
+ * integer dividers are preferred on ties and run in integer mode. If
+ * no integer divider comes within SI5351_FRAC_MS_MIN_ERROR, fractional
+ * multisynth dividers are searched as well; see si5351_plan_exact() in
+ * si5351_calc.h for the error bound. Nothing is written to the device.
  *
- * pll_freq - Desired PLL frequency in Hz * 100
- * target_pll - Which PLL to set
+ * freq - Output frequency in Hz * 100
+ * target_pll - PLL the output would run from
  *     (use the si5351_pll enum)
+ * plan - Filled in with the register values, achieved frequency and
+ *   error in micro-hertz
+ *
+ * Returns 0 on success, 1 if no divider combination is possible.
  */
-void Si5351::set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
+uint8_t Si5351::calc_plan_exact(uint64_t freq, enum si5351_pll target_pll, struct Si5351FreqPlan *plan)
 {
-  struct Si5351RegSet pll_reg;
+	uint64_t ref_freq = corrected_ref_freq(target_pll, ref_correction[target_pll == SI5351_PLLA ? plla_ref_osc : pllb_ref_osc]);
 
+	return si5351_plan_exact(freq, ref_freq, plan);
+}
+
+/*
+ * calc_plan_low_spur(uint64_t freq, enum si5351_pll target_pll, int64_t max_error, struct Si5351FreqPlan *plan)
+ *
+ * Like calc_plan_exact(), but picks the divider pair with the best
+ * jitter class and fractional spur placement whose error stays within
+ * max_error, preferring an integer PLL or an even integer multisynth
+ * over an exact fractional solution. Nothing is written to the device.
+ *
+ * freq - Output frequency in Hz * 100
+ * target_pll - PLL the output would run from
+ *     (use the si5351_pll enum)
+ * max_error - Largest acceptable output error in micro-hertz,
+ *   e.g. SI5351_LOW_SPUR_MAX_ERROR
+ * plan - Filled in as by calc_plan_exact(), including jitter_class and
+ *   spur_offset
+ *
+ * Returns 0 on success, 1 if no divider combination is possible.
+ */
+uint8_t Si5351::calc_plan_low_spur(uint64_t freq, enum si5351_pll target_pll, int64_t max_error, struct Si5351FreqPlan *plan)
+{
+	uint64_t ref_freq = corrected_ref_freq(target_pll, ref_correction[target_pll == SI5351_PLLA ? plla_ref_osc : pllb_ref_osc]);
+
+	return si5351_plan_low_spur(freq, ref_freq, max_error, plan);
+}
+
+/*
+ * calc_plan_batch(const uint64_t *freq, uint32_t count, enum si5351_pll target_pll, struct Si5351BatchResult *out)
+ *
+ * si5351_plan_batch() against the reference and correction of a PLL,
+ * i.e. what calc_plan_exact() would give for every entry of freq.
+ * Nothing is written to the device.
+ *
+ * freq - Array of output frequencies in Hz * 100
+ * count - Number of entries in freq and out
+ * target_pll - PLL the outputs would run from
+ *     (use the si5351_pll enum)
+ * out - One result per entry, see si5351_batch.h
+ *
+ * Returns the number of entries that could not be planned.
+ */
+uint32_t Si5351::calc_plan_batch(const uint64_t *freq, uint32_t count, enum si5351_pll target_pll, struct Si5351BatchResult *out)
+{
+	enum si5351_pll_input ref_osc = (target_pll == SI5351_PLLA) ? plla_ref_osc : pllb_ref_osc;
+
+	return si5351_plan_batch(freq, count, xtal_freq[(uint8_t)ref_osc] * SI5351_FREQ_MULT, ref_correction[ref_osc], out);
+}
+
+/*
+ * set_freq_plan(const struct Si5351FreqPlan *plan, enum si5351_clock clk)
+ *
+ * Write a precomputed plan to a clock output and the PLL it is assigned
+ * to. The PLL is only reset if its registers actually changed. As with
+ * set_freq_manual(), other outputs on the same PLL are not recalculated.
+ *
+ * plan - Plan from calc_plan_exact()
+ * clk - Clock output, CLK0 through CLK5 only
+ *   (use the si5351_clock enum)
+ *
+ * Returns 0 on success, 1 if the clock output cannot take a plan.
+ */
+uint8_t Si5351::set_freq_plan(const struct Si5351FreqPlan *plan, enum si5351_clock clk)
+{
+	enum si5351_pll target_pll = pll_assignment[clk];
+	uint8_t pll_addr = (target_pll == SI5351_PLLA) ? SI5351_PLLA_PARAMETERS : SI5351_PLLB_PARAMETERS;
+	bool pll_changed = false;
+	uint8_t i;
+
+	if((uint8_t)clk > (uint8_t)SI5351_CLK5)
+	{
+		return 1;
+	}
+
+	for(i = 0; i < SI5351_PARAMETERS_LENGTH; i++)
+	{
+		if(si5351_read(pll_addr + i) != plan->pll_params[i])
+		{
+			pll_changed = true;
+		}
+	}
+
+	begin_transaction();
+
+	if(clk_first_set[(uint8_t)clk] == false)
+	{
+		output_enable(clk, 1);
+		clk_first_set[(uint8_t)clk] = true;
+	}
+
+	si5351_write_bulk(pll_addr, SI5351_PARAMETERS_LENGTH, (uint8_t *)plan->pll_params);
+	set_pll_int(target_pll, &plan->pll_reg);
+	si5351_write_bulk(SI5351_CLK0_PARAMETERS + (clk * 8), SI5351_PARAMETERS_LENGTH, (uint8_t *)plan->ms_params);
+	set_int(clk, plan->int_mode);
+
+	if(pll_changed)
+	{
+		pll_reset(target_pll);
+	}
+
+	uint8_t ret_val = commit();
+
+	clk_freq[(uint8_t)clk] = plan->freq;
 	if(target_pll == SI5351_PLLA)
 	{
-		pll_calc(SI5351_PLLA, pll_freq, &pll_reg, ref_correction[plla_ref_osc], 0);
+		plla_freq = plan->pll_freq;
+		pll_stale &= ~(1 << SI5351_PLLA);
 	}
 	else
 	{
-		pll_calc(SI5351_PLLB, pll_freq, &pll_reg, ref_correction[pllb_ref_osc], 0);
+		pllb_freq = plan->pll_freq;
+		pll_stale &= ~(1 << SI5351_PLLB);
 	}
 
-  // Derive the register values to write
+	return ret_val ? 1 : 0;
+}
+
+/*
+ * calc_plan_cached(uint64_t freq, enum si5351_pll target_pll, struct Si5351FreqPlan *plan)
+ *
+ * Same plan as calc_plan_exact(), but looked up in the plan cache
+ * first and stored there on a miss. The cache is keyed on frequency,
+ * PLL and correction and is cleared whenever the reference or
+ * correction changes. Nothing is written to the device.
+ *
+ * freq - Output frequency in Hz * 100
+ * target_pll - PLL the output would run from
+ *     (use the si5351_pll enum)
+ * plan - Filled in with a copy of the cached plan
+ *
+ * Returns 0 on success, 1 if no divider combination is possible.
+ */
+uint8_t Si5351::calc_plan_cached(uint64_t freq, enum si5351_pll target_pll, struct Si5351FreqPlan *plan)
+{
+	int32_t corr = ref_correction[target_pll == SI5351_PLLA ? plla_ref_osc : pllb_ref_osc];
+	struct Si5351PlanCacheEntry *entry = NULL;
+	uint8_t i;
+
+	for(i = 0; i < SI5351_PLAN_CACHE_SIZE; i++)
+	{
+		if(plan_cache[i].valid && plan_cache[i].freq == freq &&
+			plan_cache[i].pll == target_pll && plan_cache[i].correction == corr)
+		{
+			entry = &plan_cache[i];
+			break;
+		}
+	}
+
+	if(entry == NULL)
+	{
+		// Miss, solve and take the next slot round-robin
+		entry = &plan_cache[plan_cache_next];
+		if(calc_plan_exact(freq, target_pll, &entry->plan) != 0)
+		{
+			entry->valid = false;
+			return 1;
+		}
+
+		entry->valid = true;
+		entry->freq = freq;
+		entry->pll = target_pll;
+		entry->correction = corr;
+		plan_cache_next = (plan_cache_next + 1) % SI5351_PLAN_CACHE_SIZE;
+	}
+
+	*plan = entry->plan;
+	return 0;
+}
+
+/*
+ * set_freq_cached(uint64_t freq, enum si5351_clock clk)
+ *
+ * Like set_freq() for CLK0 through CLK5, but solved with
+ * calc_plan_cached(). Repeating a frequency (for example a band table
+ * entry) only blits the stored registers.
+ *
+ * freq - Output frequency in Hz * 100
+ * clk - Clock output
+ *   (use the si5351_clock enum)
+ *
+ * Returns 0 on success, 1 if the frequency cannot be planned.
+ */
+uint8_t Si5351::set_freq_cached(uint64_t freq, enum si5351_clock clk)
+{
+	struct Si5351FreqPlan plan;
 
-  // Prepare an array for parameters to be written to
-  uint8_t *params = new uint8_t[20];
-  uint8_t i = 0;
-  uint8_t temp;
+	if((uint8_t)clk > (uint8_t)SI5351_CLK5)
+	{
+		return 1;
+	}
+
+	if(calc_plan_cached(freq, pll_assignment[clk], &plan) != 0)
+	{
+		return 1;
+	}
+
+	return set_freq_plan(&plan, clk);
+}
+
+/*
+ * set_freq_fast(uint64_t freq, enum si5351_clock clk)
+ *
+ * Phase-continuous retune for small steps such as FSK keying or sweeps.
+ * The PLL is left alone and never reset; only the fractional
+ * multisynth parameters (P1/P2/P3, plus the R divider if it changes)
+ * are rewritten, and the register shadow trims the write down to the
+ * bytes that differ.
+ *
+ * freq - Output frequency in Hz * 100
+ * clk - Clock output, CLK0 through CLK5 only
+ *   (use the si5351_clock enum)
+ *
+ * Returns 0 on success, 1 if the frequency cannot be reached from the
+ * current PLL frequency (use set_freq() instead).
+ */
+uint8_t Si5351::set_freq_fast(uint64_t freq, enum si5351_clock clk)
+{
+	uint8_t params[SI5351_PARAMETERS_LENGTH];
+
+	if((uint8_t)clk > (uint8_t)SI5351_CLK5)
+	{
+		return 1;
+	}
+
+	if(calc_ms_image(freq, pll_assignment[clk], params, NULL) != 0)
+	{
+		return 1;
+	}
+
+	begin_transaction();
+
+	if(clk_first_set[(uint8_t)clk] == false)
+	{
+		output_enable(clk, 1);
+		clk_first_set[(uint8_t)clk] = true;
+	}
+
+	set_int(clk, 0);
+	si5351_write_bulk(SI5351_CLK0_PARAMETERS + (clk * 8), SI5351_PARAMETERS_LENGTH, params);
+
+	uint8_t ret_val = commit();
+
+	clk_freq[(uint8_t)clk] = freq;
+
+	return ret_val ? 1 : 0;
+}
 
-  // Registers 26-27
-  temp = ((pll_reg.p3 >> 8) & 0xFF);
-  params[i++] = temp;
+/*
+ * calc_ms_image(uint64_t freq, enum si5351_pll pll, uint8_t *params, int64_t *error)
+ *
+ * Solve the fractional multisynth divider for freq against the PLL as it
+ * is currently programmed, with a 20-bit best rational approximation,
+ * and pack it (including the R divider bits) into the 8-byte register
+ * image used by the CLKx parameter block. Nothing is written.
+ *
+ * freq - Output frequency in Hz * 100
+ * pll - PLL driving the multisynth
+ *     (use the si5351_pll enum)
+ * params - SI5351_PARAMETERS_LENGTH bytes of output
+ * error - If not NULL, receives the output error in micro-hertz
+ *
+ * Returns 0 on success, 1 if the divider would be out of range.
+ */
+uint8_t Si5351::calc_ms_image(uint64_t freq, enum si5351_pll pll, uint8_t *params, int64_t *error)
+{
+	struct Si5351RegSet ms_reg;
+	uint64_t vco_num;
+	uint32_t vco_den;
+	uint8_t r_div;
 
-  temp = (uint8_t)(pll_reg.p3  & 0xFF);
-  params[i++] = temp;
+	pll_vco_exact(pll, &vco_num, &vco_den);
 
-  // Register 28
-  temp = (uint8_t)((pll_reg.p1 >> 16) & 0x03);
-  params[i++] = temp;
+	if(ms_calc_exact(freq, vco_num, vco_den, &ms_reg, &r_div, error) != 0)
+	{
+		return 1;
+	}
 
-  // Registers 29-30
-  temp = (uint8_t)((pll_reg.p1 >> 8) & 0xFF);
-  params[i++] = temp;
+	si5351_pack_regset(&ms_reg, params);
+	params[2] |= (r_div << SI5351_OUTPUT_CLK_DIV_SHIFT);
 
-  temp = (uint8_t)(pll_reg.p1  & 0xFF);
-  params[i++] = temp;
+	return 0;
+}
 
-  // Register 31
-  temp = (uint8_t)((pll_reg.p3 >> 12) & 0xF0);
-  temp += (uint8_t)((pll_reg.p2 >> 16) & 0x0F);
-  params[i++] = temp;
+/*
+ * ms_calc_exact(uint64_t freq, uint64_t vco_num, uint32_t vco_den, struct Si5351RegSet *reg, uint8_t *r_div, int64_t *error)
+ *
+ * Fractional multisynth divider a + b/c closest to
+ * (vco_num / vco_den) / (freq * R), with c up to 20 bits. The R divider
+ * is chosen as in set_freq().
+ *
+ * Returns 0 on success, 1 if the divider is out of range or the output
+ * would need DIVBY4 mode.
+ */
+uint8_t Si5351::ms_calc_exact(uint64_t freq, uint64_t vco_num, uint32_t vco_den, struct Si5351RegSet *reg, uint8_t *r_div, int64_t *error)
+{
+	uint64_t freq_r = freq;
+	uint32_t a, b, c;
+
+	if(freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT)
+	{
+		return 1;
+	}
 
-  // Registers 32-33
-  temp = (uint8_t)((pll_reg.p2 >> 8) & 0xFF);
-  params[i++] = temp;
+	*r_div = si5351_select_r_div(&freq_r);
 
-  temp = (uint8_t)(pll_reg.p2  & 0xFF);
-  params[i++] = temp;
+	// DIVBY4 needs integer mode and a VCO locked to the output
+	if(freq_r >= SI5351_MULTISYNTH_DIVBY4_FREQ * SI5351_FREQ_MULT)
+	{
+		return 1;
+	}
+
+	uint64_t den = (uint64_t)vco_den * freq_r;
+	a = vco_num / den;
+
+	if(a < SI5351_MULTISYNTH_A_MIN || a >= SI5351_MULTISYNTH_A_MAX)
+	{
+		return 1;
+	}
+
+	si5351_rational_approx(vco_num % den, den, SI5351_MULTISYNTH_C_MAX, &b, &c);
+
+	if(b == c)
+	{
+		a++;
+		b = 0;
+	}
+	if(b == 0)
+	{
+		c = 1;
+	}
+
+	reg->p1 = 128 * a + ((128 * b) / c) - 512;
+	reg->p2 = 128 * b - c * ((128 * b) / c);
+	reg->p3 = c;
+
+	if(error != NULL)
+	{
+		// Only for reporting, exact integer math would need 128 bits here
+		double ms = (double)a + (double)b / (double)c;
+		double actual = (double)vco_num / (double)vco_den / ms / (double)(freq_r / freq);
+		*error = (int64_t)((actual - (double)freq) * 10000.0);
+	}
+
+	return 0;
+}
+
+/*
+ * plan_pll_group(const uint64_t *freq, const uint8_t *members, uint8_t n, enum si5351_pll pll, struct Si5351FreqPlan *out)
+ *
+ * Best shared VCO for the outputs listed in members, all on one PLL.
+ * Results are written to out[member].
+ *
+ * Returns the summed absolute error in micro-hertz, or UINT64_MAX if
+ * no VCO works for every member.
+ */
+uint64_t Si5351::plan_pll_group(const uint64_t *freq, const uint8_t *members, uint8_t n, enum si5351_pll pll, struct Si5351FreqPlan *out)
+{
+	struct Si5351FreqPlan cand[SI5351_MULTI_PLAN_MAX];
+	uint64_t best_err = UINT64_MAX;
+	uint64_t ref_freq = corrected_ref_freq(pll, ref_correction[pll == SI5351_PLLA ? plla_ref_osc : pllb_ref_osc]);
+	uint8_t k, m;
+
+	if(n == 1)
+	{
+		if(calc_plan_exact(freq[members[0]], pll, &out[members[0]]) != 0)
+		{
+			return UINT64_MAX;
+		}
+		return llabs(out[members[0]].error);
+	}
+
+	for(k = 0; k < n && best_err != 0; k++)
+	{
+		struct Si5351FreqPlan anchor;
+		uint8_t anchor_clk = members[k];
+
+		// The anchor gets an integer divider, every VCO it allows is tried
+		uint64_t freq_r = freq[anchor_clk];
+		uint8_t r_div = si5351_select_r_div(&freq_r);
+		uint32_t ms_min, ms_max, ms;
+
+		if(freq_r >= SI5351_MULTISYNTH_DIVBY4_FREQ * SI5351_FREQ_MULT)
+		{
+			ms_min = 4;
+			ms_max = 4;
+		}
+		else
+		{
+			ms_min = ((SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT) + freq_r - 1) / freq_r;
+			ms_max = (SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT) / freq_r;
+			if(ms_min < SI5351_MULTISYNTH_A_MIN)
+			{
+				ms_min = SI5351_MULTISYNTH_A_MIN;
+			}
+			if(ms_max > SI5351_MULTISYNTH_A_MAX)
+			{
+				ms_max = SI5351_MULTISYNTH_A_MAX;
+			}
+		}
+
+		for(ms = ms_min; ms <= ms_max && best_err != 0; ms++)
+		{
+			uint64_t vco_num;
+			uint32_t vco_den;
+			uint64_t total_err;
+			bool ok = true;
+
+			si5351_pll_calc_exact(ref_freq, freq_r * ms, &anchor.pll_reg, &vco_num, &vco_den);
+
+			anchor.freq = freq[anchor_clk];
+			anchor.pll_freq = vco_num / vco_den;
+			anchor.r_div = r_div;
+			anchor.div_by_4 = (ms == 4) ? 1 : 0;
+			anchor.int_mode = anchor.div_by_4;
+			anchor.ms_reg.p1 = anchor.div_by_4 ? 0 : 128 * ms - 512;
+			anchor.ms_reg.p2 = 0;
+			anchor.ms_reg.p3 = 1;
+
+			uint64_t target_scaled = freq_r * ms * vco_den;
+			uint64_t err_den = (uint64_t)vco_den * ms * (freq_r / anchor.freq);
+			uint64_t err = vco_num > target_scaled ? vco_num - target_scaled : target_scaled - vco_num;
+			uint64_t err_uhz = (err * 10000ULL + err_den / 2) / err_den;
+			anchor.error = vco_num >= target_scaled ? (int64_t)err_uhz : -(int64_t)err_uhz;
+			anchor.actual_freq = (vco_num + err_den / 2) / err_den;
+			total_err = err_uhz;
+
+			cand[k] = anchor;
+
+			for(m = 0; m < n && ok; m++)
+			{
+				if(m == k)
+				{
+					continue;
+				}
+
+				struct Si5351FreqPlan *other = &cand[m];
+				other->freq = freq[members[m]];
+				other->pll_reg = anchor.pll_reg;
+				other->pll_freq = anchor.pll_freq;
+				other->div_by_4 = 0;
+				other->int_mode = 0;
+
+				if(ms_calc_exact(other->freq, vco_num, vco_den, &other->ms_reg, &other->r_div, &other->error) != 0)
+				{
+					ok = false;
+					break;
+				}
+
+				other->actual_freq = other->freq + other->error / 10000;
+				total_err += llabs(other->error);
+			}
+
+			if(ok && total_err < best_err)
+			{
+				best_err = total_err;
+				for(m = 0; m < n; m++)
+				{
+					out[members[m]] = cand[m];
+				}
+			}
+		}
+	}
+
+	if(best_err == UINT64_MAX)
+	{
+		return best_err;
+	}
+
+	for(m = 0; m < n; m++)
+	{
+		struct Si5351FreqPlan *plan = &out[members[m]];
+
+		si5351_plan_grade(plan, ref_freq);
+		si5351_plan_pack(plan);
+	}
+
+	return best_err;
+}
+
+/*
+ * pll_vco_exact(enum si5351_pll pll, uint64_t *vco_num, uint32_t *vco_den)
+ *
+ * Exact VCO frequency of a PLL, vco_num / vco_den in Hz * 100, decoded
+ * from its programmed P1/P2/P3 using the identity
+ * P3 * (P1 + 512) + P2 = 128 * (a * c + b).
+ */
+void Si5351::pll_vco_exact(enum si5351_pll pll, uint64_t *vco_num, uint32_t *vco_den)
+{
+	uint8_t base = (pll == SI5351_PLLA) ? SI5351_PLLA_PARAMETERS : SI5351_PLLB_PARAMETERS;
+	uint32_t p1, p2, p3;
+
+	p3 = ((uint32_t)(si5351_read(base + 5) & 0xF0) << 12) | ((uint32_t)si5351_read(base) << 8) | si5351_read(base + 1);
+	p1 = ((uint32_t)(si5351_read(base + 2) & 0x03) << 16) | ((uint32_t)si5351_read(base + 3) << 8) | si5351_read(base + 4);
+	p2 = ((uint32_t)(si5351_read(base + 5) & 0x0F) << 16) | ((uint32_t)si5351_read(base + 6) << 8) | si5351_read(base + 7);
+
+	if(p3 == 0)
+	{
+		// Never programmed, fall back to the nominal frequency
+		*vco_num = (pll == SI5351_PLLA) ? plla_freq : pllb_freq;
+		*vco_den = 1;
+		return;
+	}
+
+	uint64_t ref_freq = corrected_ref_freq(pll, ref_correction[pll == SI5351_PLLA ? plla_ref_osc : pllb_ref_osc]);
+
+	*vco_num = ref_freq * (((uint64_t)p3 * (p1 + 512) + p2) / 128);
+	*vco_den = p3;
+}
+
+/*
+ * clear_plan_cache(void)
+ *
+ * Drop every plan remembered by set_freq_cached().
+ */
+void Si5351::clear_plan_cache(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < SI5351_PLAN_CACHE_SIZE; i++)
+	{
+		plan_cache[i].valid = false;
+	}
+	plan_cache_next = 0;
+}
+
+/*
+ * plan_outputs(const uint64_t *freq, uint8_t count, struct Si5351MultiPlan *plan)
+ *
+ * Plan up to SI5351_MULTI_PLAN_MAX outputs (CLK0 upward) at once. Every
+ * split of the outputs between PLLA and PLLB is tried. An output alone
+ * on a PLL gets the calc_plan_exact() solution. For outputs sharing a
+ * PLL, each one in turn anchors the VCO with an integer divider and the
+ * others get fractional dividers from that VCO. The plan with the
+ * smallest summed error wins. Nothing is written; see set_multi_plan().
+ *
+ * freq - Array of output frequencies in Hz * 100, 0 for an unused output
+ * count - Number of entries in freq
+ * plan - Filled in with the PLL assignment and per-output plans
+ *
+ * Returns 0 on success, 1 if no assignment can produce every output.
+ */
+uint8_t Si5351::plan_outputs(const uint64_t *freq, uint8_t count, struct Si5351MultiPlan *plan)
+{
+	struct Si5351FreqPlan trial[SI5351_MULTI_PLAN_MAX];
+	uint64_t best_err = UINT64_MAX;
+	uint8_t mask, i;
+
+	if(count == 0 || count > SI5351_MULTI_PLAN_MAX)
+	{
+		return 1;
+	}
+
+	for(mask = 0; mask < (1 << count); mask++)
+	{
+		uint64_t total_err = 0;
+		bool ok = true;
+
+		for(uint8_t p = 0; p < 2 && ok; p++)
+		{
+			uint8_t members[SI5351_MULTI_PLAN_MAX];
+			uint8_t n = 0;
+
+			for(i = 0; i < count; i++)
+			{
+				if(freq[i] != 0 && ((mask >> i) & 0x01) == p)
+				{
+					members[n++] = i;
+				}
+			}
+
+			if(n == 0)
+			{
+				continue;
+			}
+
+			uint64_t err = plan_pll_group(freq, members, n, (enum si5351_pll)p, trial);
+			if(err == UINT64_MAX)
+			{
+				ok = false;
+			}
+			else
+			{
+				total_err += err;
+			}
+		}
+
+		if(ok && total_err < best_err)
+		{
+			best_err = total_err;
+			plan->count = count;
+			plan->total_error = total_err;
+			for(i = 0; i < count; i++)
+			{
+				plan->pll[i] = ((mask >> i) & 0x01) ? SI5351_PLLB : SI5351_PLLA;
+				plan->used[i] = (freq[i] != 0);
+				if(plan->used[i])
+				{
+					plan->out[i] = trial[i];
+				}
+			}
+
+			if(best_err == 0)
+			{
+				break;
+			}
+		}
+	}
+
+	return best_err == UINT64_MAX ? 1 : 0;
+}
+
+/*
+ * set_multi_plan(const struct Si5351MultiPlan *plan)
+ *
+ * Commit a plan from plan_outputs() in one transaction: PLL parameters,
+ * multisynth source, parameters and integer mode for every used output,
+ * then a reset of each PLL whose registers changed.
+ *
+ * Returns 0 on success, 1 if the bus reported an error.
+ */
+uint8_t Si5351::set_multi_plan(const struct Si5351MultiPlan *plan)
+{
+	bool pll_written[2] = {false, false};
+	bool pll_changed[2] = {false, false};
+	uint8_t i, j;
+
+	begin_transaction();
+
+	for(i = 0; i < plan->count; i++)
+	{
+		if(!plan->used[i])
+		{
+			continue;
+		}
+
+		enum si5351_clock clk = (enum si5351_clock)i;
+		enum si5351_pll pll = plan->pll[i];
+		uint8_t pll_addr = (pll == SI5351_PLLA) ? SI5351_PLLA_PARAMETERS : SI5351_PLLB_PARAMETERS;
+
+		if(!pll_written[pll])
+		{
+			for(j = 0; j < SI5351_PARAMETERS_LENGTH; j++)
+			{
+				if(si5351_read(pll_addr + j) != plan->out[i].pll_params[j])
+				{
+					pll_changed[pll] = true;
+				}
+			}
+
+			si5351_write_bulk(pll_addr, SI5351_PARAMETERS_LENGTH, (uint8_t *)plan->out[i].pll_params);
+			set_pll_int(pll, &plan->out[i].pll_reg);
+			pll_written[pll] = true;
+
+			if(pll == SI5351_PLLA)
+			{
+				plla_freq = plan->out[i].pll_freq;
+				pll_stale &= ~(1 << SI5351_PLLA);
+			}
+			else
+			{
+				pllb_freq = plan->out[i].pll_freq;
+				pll_stale &= ~(1 << SI5351_PLLB);
+			}
+		}
+
+		set_ms_source(clk, pll);
+		si5351_write_bulk(SI5351_CLK0_PARAMETERS + (clk * 8), SI5351_PARAMETERS_LENGTH, (uint8_t *)plan->out[i].ms_params);
+		set_int(clk, plan->out[i].int_mode);
+
+		if(clk_first_set[i] == false)
+		{
+			output_enable(clk, 1);
+			clk_first_set[i] = true;
+		}
+
+		clk_freq[i] = plan->out[i].freq;
+	}
+
+	for(i = 0; i < 2; i++)
+	{
+		if(pll_changed[i])
+		{
+			pll_reset((enum si5351_pll)i);
+		}
+	}
+
+	return commit() ? 1 : 0;
+}
+
+/*
+ * set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
+ *
+ * Set the specified PLL to a specific oscillation frequency
+ *
+ * pll_freq - Desired PLL frequency in Hz * 100
+ * target_pll - Which PLL to set
+ *     (use the si5351_pll enum)
+ */
+void Si5351::set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
+{
+  struct Si5351RegSet pll_reg;
+
+	if(target_pll == SI5351_PLLA)
+	{
+		pll_calc(SI5351_PLLA, pll_freq, &pll_reg, ref_correction[plla_ref_osc], 0);
+	}
+	else
+	{
+		pll_calc(SI5351_PLLB, pll_freq, &pll_reg, ref_correction[pllb_ref_osc], 0);
+	}
+
+  // Derive the register values to write
+  uint8_t params[SI5351_PARAMETERS_LENGTH];
+  si5351_pack_regset(&pll_reg, params);
 
   // Write the parameters
+  set_pll_int(target_pll, &pll_reg);
   if(target_pll == SI5351_PLLA)
   {
-    si5351_write_bulk(SI5351_PLLA_PARAMETERS, i, params);
+    si5351_write_bulk(SI5351_PLLA_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 		plla_freq = pll_freq;
+		pll_stale &= ~(1 << SI5351_PLLA);
   }
   else if(target_pll == SI5351_PLLB)
   {
-    si5351_write_bulk(SI5351_PLLB_PARAMETERS, i, params);
+    si5351_write_bulk(SI5351_PLLB_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 		pllb_freq = pll_freq;
+		pll_stale &= ~(1 << SI5351_PLLB);
   }
-
-  delete params;
 }
 
 /*
@@ -586,45 +1355,18 @@ void Si5351::set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
  */
 void Si5351::set_ms(enum si5351_clock clk, struct Si5351RegSet ms_reg, uint8_t int_mode, uint8_t r_div, uint8_t div_by_4)
 {
-	uint8_t *params = new uint8_t[20];
-	uint8_t i = 0;
- 	uint8_t temp;
- 	uint8_t reg_val;
-
+	uint8_t params[SI5351_PARAMETERS_LENGTH];
+	uint8_t temp = 0;
+	uint8_t reg_val;
 
 	if((uint8_t)clk <= (uint8_t)SI5351_CLK5)
 	{
-		// Registers 42-43 for CLK0
-		temp = (uint8_t)((ms_reg.p3 >> 8) & 0xFF);
-		params[i++] = temp;
-
-		temp = (uint8_t)(ms_reg.p3  & 0xFF);
-		params[i++] = temp;
+		si5351_pack_regset(&ms_reg, params);
 
-		// Register 44 for CLK0
+		// Register 44 for CLK0 also holds the R divider and DIVBY4 bits,
+		// keep those from the current register contents
 		reg_val = si5351_read((SI5351_CLK0_PARAMETERS + 2) + (clk * 8));
-		reg_val &= ~(0x03);
-		temp = reg_val | ((uint8_t)((ms_reg.p1 >> 16) & 0x03));
-		params[i++] = temp;
-
-		// Registers 45-46 for CLK0
-		temp = (uint8_t)((ms_reg.p1 >> 8) & 0xFF);
-		params[i++] = temp;
-
-		temp = (uint8_t)(ms_reg.p1  & 0xFF);
-		params[i++] = temp;
-
-		// Register 47 for CLK0
-		temp = (uint8_t)((ms_reg.p3 >> 12) & 0xF0);
-		temp += (uint8_t)((ms_reg.p2 >> 16) & 0x0F);
-		params[i++] = temp;
-
-		// Registers 48-49 for CLK0
-		temp = (uint8_t)((ms_reg.p2 >> 8) & 0xFF);
-		params[i++] = temp;
-
-		temp = (uint8_t)(ms_reg.p2  & 0xFF);
-		params[i++] = temp;
+		params[2] |= reg_val & ~(0x03);
 	}
 	else
 	{
@@ -636,32 +1378,32 @@ void Si5351::set_ms(enum si5351_clock clk, struct Si5351RegSet ms_reg, uint8_t i
 	switch(clk)
 	{
 		case SI5351_CLK0:
-			si5351_write_bulk(SI5351_CLK0_PARAMETERS, i, params);
+			si5351_write_bulk(SI5351_CLK0_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 			set_int(clk, int_mode);
 			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK1:
-			si5351_write_bulk(SI5351_CLK1_PARAMETERS, i, params);
+			si5351_write_bulk(SI5351_CLK1_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 			set_int(clk, int_mode);
 			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK2:
-			si5351_write_bulk(SI5351_CLK2_PARAMETERS, i, params);
+			si5351_write_bulk(SI5351_CLK2_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 			set_int(clk, int_mode);
 			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK3:
-			si5351_write_bulk(SI5351_CLK3_PARAMETERS, i, params);
+			si5351_write_bulk(SI5351_CLK3_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 			set_int(clk, int_mode);
 			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK4:
-			si5351_write_bulk(SI5351_CLK4_PARAMETERS, i, params);
+			si5351_write_bulk(SI5351_CLK4_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 			set_int(clk, int_mode);
 			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK5:
-			si5351_write_bulk(SI5351_CLK5_PARAMETERS, i, params);
+			si5351_write_bulk(SI5351_CLK5_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 			set_int(clk, int_mode);
 			ms_div(clk, r_div, div_by_4);
 			break;
@@ -674,8 +1416,6 @@ void Si5351::set_ms(enum si5351_clock clk, struct Si5351RegSet ms_reg, uint8_t i
 			ms_div(clk, r_div, div_by_4);
 			break;
 	}
-
-	delete params;
 }
 
 /*
@@ -694,6 +1434,11 @@ void Si5351::output_enable(enum si5351_clock clk, uint8_t enable)
 
   if(enable == 1)
   {
+    // Bring the PLL up to date with a correction made while it was idle
+    if(pll_stale & (1 << (uint8_t)pll_assignment[clk]))
+    {
+      refresh_pll(pll_assignment[clk]);
+    }
     reg_val &= ~(1<<(uint8_t)clk);
   }
   else
@@ -784,14 +1529,140 @@ void Si5351::update_status(void)
  * the Si5351. Once this calibration is done accurately, it
  * should not have to be done again for the same Si5351 and
  * crystal.
+ *
+ * The change is applied incrementally through trim_correction(),
+ * so running outputs are retuned without a PLL reset.
  */
 void Si5351::set_correction(int32_t corr, enum si5351_pll_input ref_osc)
 {
+	// Cached plans were solved against the old reference
+	clear_plan_cache();
+
+	trim_correction(corr, ref_osc);
+}
+
+/*
+ * trim_correction(int32_t corr, enum si5351_pll_input ref_osc)
+ *
+ * corr - Correction factor in ppb
+ * ref_osc - Desired reference oscillator
+ *     (use the si5351_pll_input enum)
+ *
+ * Apply a new correction without touching anything that does not depend
+ * on it. Only PLLs fed by ref_osc that drive an enabled output are
+ * re-solved, for their current nominal VCO frequency, with no PLL reset
+ * and no multisynth writes. The register shadow trims the write to the
+ * bytes that changed. An idle PLL is marked stale and catches up when
+ * one of its outputs is enabled or a frequency is set on it. The plan cache is left alone since it is
+ * keyed on the correction, which suits small, frequent adjustments such
+ * as drift compensation.
+ *
+ * Returns 0 on success, 1 if the bus reported an error.
+ */
+uint8_t Si5351::trim_correction(int32_t corr, enum si5351_pll_input ref_osc)
+{
+	uint8_t i;
+
 	ref_correction[(uint8_t)ref_osc] = corr;
 
-	// Recalculate and set PLL freqs based on correction value
-	set_pll(plla_freq, SI5351_PLLA);
-	set_pll(pllb_freq, SI5351_PLLB);
+	begin_transaction();
+
+	for(i = 0; i < 2; i++)
+	{
+		enum si5351_pll pll = (enum si5351_pll)i;
+
+		if((pll == SI5351_PLLA ? plla_ref_osc : pllb_ref_osc) != ref_osc)
+		{
+			continue;
+		}
+
+		if(pll_in_use(pll))
+		{
+			refresh_pll(pll);
+		}
+		else
+		{
+			// Caught up by output_enable() or the next frequency change
+			pll_stale |= (1 << i);
+		}
+	}
+
+	return commit() ? 1 : 0;
+}
+
+/*
+ * refresh_pll(enum si5351_pll pll)
+ *
+ * Re-solve the feedback divider of a PLL for its nominal VCO frequency
+ * against the current reference correction, without a PLL reset.
+ */
+void Si5351::refresh_pll(enum si5351_pll pll)
+{
+	uint64_t target = (pll == SI5351_PLLA) ? plla_freq : pllb_freq;
+	struct Si5351RegSet pll_reg;
+	uint8_t params[SI5351_PARAMETERS_LENGTH];
+	uint64_t vco_num;
+	uint32_t vco_den;
+
+	pll_stale &= ~(1 << (uint8_t)pll);
+
+	if(target == 0)
+	{
+		return;
+	}
+
+	uint64_t ref_freq = corrected_ref_freq(pll, ref_correction[pll == SI5351_PLLA ? plla_ref_osc : pllb_ref_osc]);
+
+	si5351_pll_calc_exact(ref_freq, target, &pll_reg, &vco_num, &vco_den);
+	si5351_pack_regset(&pll_reg, params);
+	si5351_write_bulk(pll == SI5351_PLLA ? SI5351_PLLA_PARAMETERS : SI5351_PLLB_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
+	set_pll_int(pll, &pll_reg);
+}
+
+/*
+ * set_pll_int(enum si5351_pll pll, const struct Si5351RegSet *pll_reg)
+ *
+ * Keep the FBA_INT / FBB_INT bit in step with the feedback divider
+ * just written: integer mode for a + 0/c, fractional otherwise. Only
+ * touches the bus when the bit actually changes.
+ */
+void Si5351::set_pll_int(enum si5351_pll pll, const struct Si5351RegSet *pll_reg)
+{
+	uint8_t reg = (pll == SI5351_PLLA) ? SI5351_CLK6_CTRL : SI5351_CLK7_CTRL;
+	uint8_t reg_val = si5351_read(reg);
+	uint8_t new_val = reg_val & ~SI5351_FB_INTEGER_MODE;
+
+	if(pll_reg->p2 == 0 && (pll_reg->p1 + 512) % 128 == 0)
+	{
+		new_val |= SI5351_FB_INTEGER_MODE;
+	}
+	if(new_val != reg_val)
+	{
+		si5351_write(reg, new_val);
+	}
+}
+
+/*
+ * pll_in_use(enum si5351_pll pll)
+ *
+ * True if a powered-up, enabled clock output is assigned to the PLL.
+ * Answered from the register shadow, so it costs no bus traffic.
+ */
+bool Si5351::pll_in_use(enum si5351_pll pll)
+{
+	uint8_t oe = si5351_read(SI5351_OUTPUT_ENABLE_CTRL);
+	uint8_t clk;
+
+	for(clk = 0; clk < 8; clk++)
+	{
+		if(pll_assignment[clk] == pll && (oe & (1 << clk)) == 0 &&
+			(si5351_read(SI5351_CLK0_CTRL + clk) & SI5351_CLK_POWERDOWN) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
 }
 
 /*
@@ -1062,7 +1933,104 @@ void Si5351::set_clock_disable(enum si5351_clock clk, enum si5351_clock_disable
 		reg_val |= dis_state << ((clk - 4) * 2);
 	}
 
-	si5351_write(reg, reg_val);
+	si5351_write(reg, reg_val);
+}
+
+/*
+ * get_output_state(enum si5351_clock clk, struct Si5351OutputState *state)
+ *
+ * clk - Clock output
+ *   (use the si5351_clock enum)
+ * state - Filled in with the output enable, drive strength, invert,
+ *   power, source and disable state currently held by the device
+ *
+ * Decoded from the register shadow, so normally no bus access.
+ */
+void Si5351::get_output_state(enum si5351_clock clk, struct Si5351OutputState *state)
+{
+	uint8_t ctrl = si5351_read(SI5351_CLK0_CTRL + (uint8_t)clk);
+	uint8_t dis_reg = (clk <= SI5351_CLK3) ? SI5351_CLK3_0_DISABLE_STATE : SI5351_CLK7_4_DISABLE_STATE;
+	uint8_t dis_shift = ((uint8_t)clk & 0x03) * 2;
+
+	state->enabled = (si5351_read(SI5351_OUTPUT_ENABLE_CTRL) & (1 << (uint8_t)clk)) ? 0 : 1;
+	state->drive = (enum si5351_drive)(ctrl & 0x03);
+	state->invert = (ctrl & SI5351_CLK_INVERT) ? 1 : 0;
+	state->power = (ctrl & SI5351_CLK_POWERDOWN) ? 0 : 1;
+	state->source = (enum si5351_clock_source)((ctrl & SI5351_CLK_INPUT_MASK) >> 2);
+	state->disable_state = (enum si5351_clock_disable)((si5351_read(dis_reg) >> dis_shift) & SI5351_CLK_DISABLE_STATE_MASK);
+}
+
+/*
+ * set_output_state(enum si5351_clock clk, const struct Si5351OutputState *state)
+ *
+ * clk - Clock output
+ *   (use the si5351_clock enum)
+ * state - Desired output enable, drive strength, invert, power, source
+ *   and disable state
+ *
+ * Applies the whole output state at once instead of one read-modify-write
+ * per setting. The output enable, CLKx_CTRL and disable state registers
+ * are each staged at most once and only written if they change. Call it
+ * inside a begin_transaction()/commit() pair, together with a frequency
+ * change or the states of other outputs, to send everything in a single
+ * commit.
+ *
+ * Returns 0 on success or the bus write status.
+ */
+uint8_t Si5351::set_output_state(enum si5351_clock clk, const struct Si5351OutputState *state)
+{
+	uint8_t ctrl_reg = SI5351_CLK0_CTRL + (uint8_t)clk;
+	uint8_t dis_reg = (clk <= SI5351_CLK3) ? SI5351_CLK3_0_DISABLE_STATE : SI5351_CLK7_4_DISABLE_STATE;
+	uint8_t dis_shift = ((uint8_t)clk & 0x03) * 2;
+	uint8_t ctrl, oe, dis;
+
+	if((uint8_t)clk > (uint8_t)SI5351_CLK7)
+	{
+		return 1;
+	}
+
+	begin_transaction();
+
+	ctrl = si5351_read(ctrl_reg);
+	ctrl &= ~(SI5351_CLK_POWERDOWN | SI5351_CLK_INVERT | 0x03);
+	ctrl |= (uint8_t)state->drive & 0x03;
+	if(state->invert)
+	{
+		ctrl |= SI5351_CLK_INVERT;
+	}
+	if(!state->power)
+	{
+		ctrl |= SI5351_CLK_POWERDOWN;
+	}
+	// CLK0 cannot take MS0 as a source, it already is MS0
+	if(!(state->source == SI5351_CLK_SRC_MS0 && clk == SI5351_CLK0))
+	{
+		ctrl = (ctrl & ~SI5351_CLK_INPUT_MASK) | (((uint8_t)state->source << 2) & SI5351_CLK_INPUT_MASK);
+	}
+	si5351_write(ctrl_reg, ctrl);
+
+	dis = si5351_read(dis_reg);
+	dis &= ~(SI5351_CLK_DISABLE_STATE_MASK << dis_shift);
+	dis |= ((uint8_t)state->disable_state & SI5351_CLK_DISABLE_STATE_MASK) << dis_shift;
+	si5351_write(dis_reg, dis);
+
+	oe = si5351_read(SI5351_OUTPUT_ENABLE_CTRL);
+	if(state->enabled)
+	{
+		// Bring the PLL up to date with a correction made while it was idle
+		if(pll_stale & (1 << (uint8_t)pll_assignment[clk]))
+		{
+			refresh_pll(pll_assignment[clk]);
+		}
+		oe &= ~(1 << (uint8_t)clk);
+	}
+	else
+	{
+		oe |= (1 << (uint8_t)clk);
+	}
+	si5351_write(SI5351_OUTPUT_ENABLE_CTRL, oe);
+
+	return commit();
 }
 
 /*
@@ -1172,6 +2140,8 @@ void Si5351::set_pll_input(enum si5351_pll pll, enum si5351_pll_input input)
 
 	si5351_write(SI5351_PLL_INPUT_SOURCE, reg_val);
 
+	clear_plan_cache();
+
 	set_pll(plla_freq, SI5351_PLLA);
 	set_pll(pllb_freq, SI5351_PLLB);
 }
@@ -1204,46 +2174,12 @@ void Si5351::set_vcxo(uint64_t pll_freq, uint8_t ppm)
 	vcxo_param = pll_calc(SI5351_PLLB, pll_freq, &pll_reg, ref_correction[pllb_ref_osc], 1);
 
 	// Derive the register values to write
-
-	// Prepare an array for parameters to be written to
-	uint8_t *params = new uint8_t[20];
-	uint8_t i = 0;
+	uint8_t params[SI5351_PARAMETERS_LENGTH];
 	uint8_t temp;
-
-	// Registers 26-27
-	temp = ((pll_reg.p3 >> 8) & 0xFF);
-	params[i++] = temp;
-
-	temp = (uint8_t)(pll_reg.p3  & 0xFF);
-	params[i++] = temp;
-
-	// Register 28
-	temp = (uint8_t)((pll_reg.p1 >> 16) & 0x03);
-	params[i++] = temp;
-
-	// Registers 29-30
-	temp = (uint8_t)((pll_reg.p1 >> 8) & 0xFF);
-	params[i++] = temp;
-
-	temp = (uint8_t)(pll_reg.p1  & 0xFF);
-	params[i++] = temp;
-
-	// Register 31
-	temp = (uint8_t)((pll_reg.p3 >> 12) & 0xF0);
-	temp += (uint8_t)((pll_reg.p2 >> 16) & 0x0F);
-	params[i++] = temp;
-
-	// Registers 32-33
-	temp = (uint8_t)((pll_reg.p2 >> 8) & 0xFF);
-	params[i++] = temp;
-
-	temp = (uint8_t)(pll_reg.p2  & 0xFF);
-	params[i++] = temp;
+	si5351_pack_regset(&pll_reg, params);
 
 	// Write the parameters
-	si5351_write_bulk(SI5351_PLLB_PARAMETERS, i, params);
-
-	delete params;
+	si5351_write_bulk(SI5351_PLLB_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 
 	// Write the VCXO parameters
 	vcxo_param = ((vcxo_param * ppm * SI5351_VCXO_MARGIN) / 100ULL) / 1000000ULL;
@@ -1275,6 +2211,8 @@ void Si5351::set_ref_freq(uint32_t ref_freq, enum si5351_pll_input ref_osc)
 	// Clear the bits first
 	//reg_val &= ~(SI5351_CLKIN_DIV_MASK);
 
+	clear_plan_cache();
+
 	if(ref_freq <= 30000000UL)
 	{
 		xtal_freq[(uint8_t)ref_osc] = ref_freq;
@@ -1310,67 +2248,261 @@ void Si5351::set_ref_freq(uint32_t ref_freq, enum si5351_pll_input ref_osc)
 	//si5351_write(SI5351_PLL_INPUT_SOURCE, reg_val);
 }
 
+/*
+ * si5351_write_bulk(uint8_t addr, uint8_t bytes, uint8_t *data)
+ *
+ * Write a block of consecutive registers. Bytes which already match the
+ * register shadow are trimmed from both ends of the block, and nothing is
+ * sent at all if the whole block is unchanged.
+ *
+ * Inside a transaction the data is only staged, see begin_transaction().
+ *
+ * Returns the bus write status, or 0 if no write was needed.
+ */
 uint8_t Si5351::si5351_write_bulk(uint8_t addr, uint8_t bytes, uint8_t *data)
 {
-	Wire.beginTransmission(i2c_bus_addr);
-	Wire.write(addr);
+	int first = -1;
+	int last = -1;
+
+	if(txn_depth > 0)
+	{
+		return stage_write(addr, bytes, data);
+	}
+
+	check_bus_errors();
 	for(int i = 0; i < bytes; i++)
 	{
-		Wire.write(data[i]);
+		uint8_t reg = addr + i;
+		if(!reg_known(reg) || reg_shadow[reg] != data[i])
+		{
+			if(first < 0)
+			{
+				first = i;
+			}
+			last = i;
+		}
+	}
+
+	if(first < 0)
+	{
+		return 0;
+	}
+
+	uint8_t ret_val = bus_write_bulk(addr + first, last - first + 1, data + first);
+
+	for(int i = first; i <= last; i++)
+	{
+		if(ret_val == 0)
+		{
+			shadow_store(addr + i, data[i]);
+		}
+		else
+		{
+			// Unknown outcome, force the next access back to the device
+			reg_valid[(uint8_t)(addr + i) >> 3] &= ~(1 << ((addr + i) & 0x07));
+		}
 	}
-	return Wire.endTransmission();
 
+	return ret_val;
 }
 
+/*
+ * si5351_write(uint8_t addr, uint8_t data)
+ *
+ * Write a single register, skipping the bus transaction if the shadow
+ * shows that the register already holds this value.
+ */
 uint8_t Si5351::si5351_write(uint8_t addr, uint8_t data)
 {
-	Wire.beginTransmission(i2c_bus_addr);
-	Wire.write(addr);
-	Wire.write(data);
-	return Wire.endTransmission();
+	return si5351_write_bulk(addr, 1, &data);
 }
 
+/*
+ * si5351_read(uint8_t addr)
+ *
+ * Read a single register. Configuration registers are served from the
+ * register shadow; status registers always go to the device.
+ */
 uint8_t Si5351::si5351_read(uint8_t addr)
 {
 	uint8_t reg_val = 0;
 
-	Wire.beginTransmission(i2c_bus_addr);
-	Wire.write(addr);
-	Wire.endTransmission();
-
-	Wire.requestFrom(i2c_bus_addr, (uint8_t)1);
+	check_bus_errors();
+	if(reg_known(addr))
+	{
+		return reg_shadow[addr];
+	}
 
-	while(Wire.available())
+	if(bus_read_bulk(addr, 1, &reg_val) == 1)
 	{
-		reg_val = Wire.read();
+		shadow_store(addr, reg_val);
 	}
 
 	return reg_val;
 }
 
-/*********************/
-/* Private functions */
-/*********************/
+/*
+ * begin_transaction(void)
+ *
+ * Start staging register writes instead of sending them. Staged values
+ * are visible to si5351_read() right away but only reach the device on
+ * the matching commit(). Transactions nest; only the outermost commit()
+ * touches the bus. The outermost one first drops the shadow if the bus
+ * has reported failed writes since it was last checked.
+ */
+void Si5351::begin_transaction(void)
+{
+	check_bus_errors();
+	txn_depth++;
+}
 
-uint64_t Si5351::pll_calc(enum si5351_pll pll, uint64_t freq, struct Si5351RegSet *reg, int32_t correction, uint8_t vcxo)
+/*
+ * commit(void)
+ *
+ * Close a transaction. When the outermost transaction is closed, all
+ * dirty registers are written in ascending address order, merging runs
+ * separated by a few unchanged registers into one burst. A staged PLL
+ * reset is sent last, after the new PLL and multisynth values.
+ *
+ * Returns 0 on success or the first non-zero bus write status.
+ */
+uint8_t Si5351::commit(void)
 {
-	uint64_t ref_freq;
-	if(pll == SI5351_PLLA)
+	uint8_t ret_val = 0;
+	uint16_t addr = 0;
+
+	if(txn_depth == 0)
 	{
-		ref_freq = xtal_freq[(uint8_t)plla_ref_osc] * SI5351_FREQ_MULT;
+		return 0;
 	}
-	else
+
+	if(--txn_depth > 0)
 	{
-		ref_freq = xtal_freq[(uint8_t)pllb_ref_osc] * SI5351_FREQ_MULT;
+		return 0;
 	}
-	//ref_freq = 15974400ULL * SI5351_FREQ_MULT;
-	uint32_t a, b, c, p1, p2, p3;
-	uint64_t lltmp; //, denom;
 
-	// Factor calibration value into nominal crystal frequency
-	// Measured in parts-per-billion
+	while(addr < SI5351_REGISTER_COUNT)
+	{
+		if(!reg_dirty_get(addr))
+		{
+			addr++;
+			continue;
+		}
+
+		// Extend the run over dirty registers and short gaps of known ones
+		uint16_t start = addr;
+		uint16_t end = addr;
+		uint16_t next = addr + 1;
+
+		while(next < SI5351_REGISTER_COUNT && (next - start) < SI5351_WRITE_CHUNK)
+		{
+			if(reg_dirty_get(next))
+			{
+				end = next;
+				next++;
+				continue;
+			}
+
+			uint16_t gap = next;
+			while(gap < SI5351_REGISTER_COUNT && (gap - end - 1) < SI5351_COMMIT_GAP &&
+				!reg_dirty_get(gap) && reg_known(gap))
+			{
+				gap++;
+			}
+
+			if(gap < SI5351_REGISTER_COUNT && (gap - end - 1) <= SI5351_COMMIT_GAP &&
+				reg_dirty_get(gap) && (gap - start) < SI5351_WRITE_CHUNK)
+			{
+				end = gap;
+				next = gap + 1;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		uint8_t status = bus_write_bulk((uint8_t)start, end - start + 1, &reg_shadow[start]);
+
+		for(uint16_t i = start; i <= end; i++)
+		{
+			reg_dirty[i >> 3] &= ~(1 << (i & 0x07));
+			if(status != 0)
+			{
+				reg_valid[i >> 3] &= ~(1 << (i & 0x07));
+			}
+		}
+
+		if(status != 0 && ret_val == 0)
+		{
+			ret_val = status;
+		}
+
+		addr = end + 1;
+	}
+
+	if(pending_pll_reset != 0)
+	{
+		uint8_t reset_val = pending_pll_reset;
+		pending_pll_reset = 0;
+
+		uint8_t status = bus_write_bulk(SI5351_PLL_RESET, 1, &reset_val);
+		if(status != 0 && ret_val == 0)
+		{
+			ret_val = status;
+		}
+	}
+
+	return ret_val;
+}
+
+/*
+ * sync_shadow(void)
+ *
+ * Refresh the whole register shadow from the device using burst reads.
+ * Call this if something other than this library may have written to
+ * the Si5351.
+ */
+void Si5351::sync_shadow(void)
+{
+	uint8_t buf[SI5351_READ_CHUNK];
+	uint16_t addr;
+
+	invalidate_shadow();
+
+	for(addr = 0; addr < SI5351_REGISTER_COUNT; addr += SI5351_READ_CHUNK)
+	{
+		uint8_t count = bus_read_bulk((uint8_t)addr, SI5351_READ_CHUNK, buf);
+
+		for(uint8_t i = 0; i < count; i++)
+		{
+			shadow_store((uint8_t)(addr + i), buf[i]);
+		}
+	}
+}
+
+/*
+ * invalidate_shadow(void)
+ *
+ * Mark every shadowed register as unknown so that the next read of each
+ * one goes to the device.
+ */
+void Si5351::invalidate_shadow(void)
+{
+	memset(reg_valid, 0, sizeof(reg_valid));
+	memset(reg_dirty, 0, sizeof(reg_dirty));
+	pending_pll_reset = 0;
+}
+
+/*********************/
+/* Private functions */
+/*********************/
 
-	ref_freq = ref_freq + (int32_t)((((((int64_t)correction) << 31) / 1000000000LL) * ref_freq) >> 31);
+uint64_t Si5351::pll_calc(enum si5351_pll pll, uint64_t freq, struct Si5351RegSet *reg, int32_t correction, uint8_t vcxo)
+{
+	uint64_t ref_freq = corrected_ref_freq(pll, correction);
+	uint32_t a, b, c, p1, p2, p3;
+	uint64_t lltmp; //, denom;
 
 	// PLL bounds checking
 	if (freq < SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT)
@@ -1625,11 +2757,39 @@ uint64_t Si5351::multisynth67_calc(uint64_t freq, uint64_t pll_freq, struct Si53
 	}
 }
 
+/*
+ * corrected_ref_freq(enum si5351_pll pll, int32_t correction)
+ *
+ * Reference frequency feeding the given PLL in Hz * 100, with the
+ * parts-per-billion calibration value factored in.
+ */
+uint64_t Si5351::corrected_ref_freq(enum si5351_pll pll, int32_t correction)
+{
+	uint64_t ref_freq;
+	if(pll == SI5351_PLLA)
+	{
+		ref_freq = xtal_freq[(uint8_t)plla_ref_osc] * SI5351_FREQ_MULT;
+	}
+	else
+	{
+		ref_freq = xtal_freq[(uint8_t)pllb_ref_osc] * SI5351_FREQ_MULT;
+	}
+	//ref_freq = 15974400ULL * SI5351_FREQ_MULT;
+
+	// Factor calibration value into nominal crystal frequency
+	// Measured in parts-per-billion
+	return si5351_correct_ref(ref_freq, correction);
+}
+
 void Si5351::update_sys_status(struct Si5351Status *status)
 {
   uint8_t reg_val = 0;
 
-  reg_val = si5351_read(SI5351_DEVICE_STATUS);
+  // Keep the last status rather than report an all-clear on a short read
+  if(bus_read_bulk(SI5351_DEVICE_STATUS, 1, &reg_val) != 1)
+  {
+    return;
+  }
 
   // Parse the register
   status->SYS_INIT = (reg_val >> 7) & 0x01;
@@ -1643,7 +2803,10 @@ void Si5351::update_int_status(struct Si5351IntStatus *int_status)
 {
   uint8_t reg_val = 0;
 
-  reg_val = si5351_read(SI5351_INTERRUPT_STATUS);
+  if(bus_read_bulk(SI5351_INTERRUPT_STATUS, 1, &reg_val) != 1)
+  {
+    return;
+  }
 
   // Parse the register
   int_status->SYS_INIT_STKY = (reg_val >> 7) & 0x01;
@@ -1721,42 +2884,42 @@ void Si5351::ms_div(enum si5351_clock clk, uint8_t r_div, uint8_t div_by_4)
 	si5351_write(reg_addr, reg_val);
 }
 
-uint8_t Si5351::select_r_div(uint64_t *freq)
+uint8_t Si5351::select_r_div_ms67(uint64_t *freq)
 {
 	uint8_t r_div = SI5351_OUTPUT_CLK_DIV_1;
 
 	// Choose the correct R divider
-	if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 2))
+	if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 2))
 	{
 		r_div = SI5351_OUTPUT_CLK_DIV_128;
 		*freq *= 128ULL;
 	}
-	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 2) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 4))
+	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 2) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 4))
 	{
 		r_div = SI5351_OUTPUT_CLK_DIV_64;
 		*freq *= 64ULL;
 	}
-	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 4) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 8))
+	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 4) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 8))
 	{
 		r_div = SI5351_OUTPUT_CLK_DIV_32;
 		*freq *= 32ULL;
 	}
-	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 8) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 16))
+	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 8) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 16))
 	{
 		r_div = SI5351_OUTPUT_CLK_DIV_16;
 		*freq *= 16ULL;
 	}
-	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 16) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 32))
+	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 16) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 32))
 	{
 		r_div = SI5351_OUTPUT_CLK_DIV_8;
 		*freq *= 8ULL;
 	}
-	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 32) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 64))
+	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 32) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 64))
 	{
 		r_div = SI5351_OUTPUT_CLK_DIV_4;
 		*freq *= 4ULL;
 	}
-	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 64) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 128))
+	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 64) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 128))
 	{
 		r_div = SI5351_OUTPUT_CLK_DIV_2;
 		*freq *= 2ULL;
@@ -1765,46 +2928,154 @@ uint8_t Si5351::select_r_div(uint64_t *freq)
 	return r_div;
 }
 
-uint8_t Si5351::select_r_div_ms67(uint64_t *freq)
+/*
+ * Registers which the device changes on its own (status and sticky
+ * interrupt flags) or which act as strobes (PLL reset) must never be
+ * answered from, or filtered against, the shadow.
+ */
+bool Si5351::reg_cacheable(uint8_t addr)
 {
-	uint8_t r_div = SI5351_OUTPUT_CLK_DIV_1;
+	switch(addr)
+	{
+		case SI5351_DEVICE_STATUS:
+		case SI5351_INTERRUPT_STATUS:
+		case SI5351_PLL_RESET:
+			return false;
+		default:
+			return true;
+	}
+}
 
-	// Choose the correct R divider
-	if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 2))
+bool Si5351::reg_known(uint8_t addr)
+{
+	return reg_cacheable(addr) && (reg_valid[addr >> 3] & (1 << (addr & 0x07)));
+}
+
+void Si5351::shadow_store(uint8_t addr, uint8_t data)
+{
+	if(reg_cacheable(addr))
 	{
-		r_div = SI5351_OUTPUT_CLK_DIV_128;
-		*freq *= 128ULL;
+		reg_shadow[addr] = data;
+		reg_valid[addr >> 3] |= (1 << (addr & 0x07));
 	}
-	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 2) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 4))
+}
+
+uint8_t Si5351::stage_write(uint8_t addr, uint8_t bytes, uint8_t *data)
+{
+	for(uint8_t i = 0; i < bytes; i++)
 	{
-		r_div = SI5351_OUTPUT_CLK_DIV_64;
-		*freq *= 64ULL;
+		uint8_t reg = addr + i;
+
+		if(reg == SI5351_PLL_RESET)
+		{
+			// Strobe register, replayed once at commit time
+			pending_pll_reset |= data[i];
+		}
+		else if(!reg_cacheable(reg))
+		{
+			// Status writes (sticky flag clears) cannot be deferred
+			bus_write_bulk(reg, 1, &data[i]);
+		}
+		else if(!reg_known(reg) || reg_shadow[reg] != data[i])
+		{
+			shadow_store(reg, data[i]);
+			reg_dirty[reg >> 3] |= (1 << (reg & 0x07));
+		}
 	}
-	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 4) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 8))
+
+	return 0;
+}
+
+bool Si5351::reg_dirty_get(uint16_t addr)
+{
+	return reg_dirty[addr >> 3] & (1 << (addr & 0x07));
+}
+
+uint8_t Si5351::bus_write_bulk(uint8_t addr, uint8_t bytes, uint8_t *data)
+{
+	return bus->write(i2c_bus_addr, addr, bytes, data);
+}
+
+uint8_t Si5351::bus_read_bulk(uint8_t addr, uint8_t bytes, uint8_t *data)
+{
+	return bus->read(i2c_bus_addr, addr, bytes, data);
+}
+
+/*
+ * A deferring bus reports write failures after the fact. The shadow may
+ * then hold values the device never got, so it is dropped as a whole and
+ * rebuilt by the following reads and writes. Does nothing while a
+ * transaction is staged, since that would lose the staged registers and
+ * PLL reset; the next outermost begin_transaction() catches up.
+ */
+void Si5351::check_bus_errors(void)
+{
+	if(txn_depth != 0)
 	{
-		r_div = SI5351_OUTPUT_CLK_DIV_32;
-		*freq *= 32ULL;
+		return;
 	}
-	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 8) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 16))
+
+	uint32_t errors = bus->error_count();
+
+	if(errors != bus_errors_seen)
 	{
-		r_div = SI5351_OUTPUT_CLK_DIV_16;
-		*freq *= 16ULL;
+		bus_errors_seen = errors;
+		invalidate_shadow();
 	}
-	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 16) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 32))
+}
+
+#ifdef ARDUINO
+
+/******************/
+/* Wire transport */
+/******************/
+
+Si5351WireBus::Si5351WireBus(TwoWire &wire_bus):
+	wire(wire_bus)
+{
+}
+
+void Si5351WireBus::begin(void)
+{
+	wire.begin();
+}
+
+uint8_t Si5351WireBus::probe(uint8_t dev_addr)
+{
+	wire.beginTransmission(dev_addr);
+	return wire.endTransmission();
+}
+
+uint8_t Si5351WireBus::write(uint8_t dev_addr, uint8_t reg, uint8_t bytes, const uint8_t *data)
+{
+	wire.beginTransmission(dev_addr);
+	wire.write(reg);
+	for(int i = 0; i < bytes; i++)
 	{
-		r_div = SI5351_OUTPUT_CLK_DIV_8;
-		*freq *= 8ULL;
+		wire.write(data[i]);
 	}
-	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 32) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 64))
+	return wire.endTransmission();
+}
+
+uint8_t Si5351WireBus::read(uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data)
+{
+	uint8_t count = 0;
+
+	wire.beginTransmission(dev_addr);
+	wire.write(reg);
+	if(wire.endTransmission() != 0)
 	{
-		r_div = SI5351_OUTPUT_CLK_DIV_4;
-		*freq *= 4ULL;
+		return 0;
 	}
-	else if((*freq >= SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 64) && (*freq < SI5351_CLKOUT67_MIN_FREQ * SI5351_FREQ_MULT * 128))
+
+	wire.requestFrom(dev_addr, bytes);
+
+	while(wire.available() && count < bytes)
 	{
-		r_div = SI5351_OUTPUT_CLK_DIV_2;
-		*freq *= 2ULL;
+		data[count++] = wire.read();
 	}
 
-	return r_div;
+	return count;
 }
+
+#endif
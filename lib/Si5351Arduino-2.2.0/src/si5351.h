@@ -29,8 +29,11 @@
 #ifndef SI5351_H_
 #define SI5351_H_
 
+#ifdef ARDUINO
 #include "Arduino.h"
 #include "Wire.h"
+#endif
+#include <stddef.h>
 #include <stdint.h>
 
 /* Define definitions */
@@ -99,6 +102,7 @@
 #define SI5351_CLK7_CTRL                23
 #define SI5351_CLK_POWERDOWN            (1<<7)
 #define SI5351_CLK_INTEGER_MODE         (1<<6)
+#define SI5351_FB_INTEGER_MODE          (1<<6) /* FBA_INT / FBB_INT in CLK6_CTRL / CLK7_CTRL */
 #define SI5351_CLK_PLL_SELECT           (1<<5)
 #define SI5351_CLK_INVERT               (1<<4)
 #define SI5351_CLK_INPUT_MASK           (3<<2)
@@ -187,6 +191,21 @@
 #define SI5351_XTAL_ENABLE              (1<<6)
 #define SI5351_MULTISYNTH_ENABLE        (1<<4)
 
+#define SI5351_REGISTER_COUNT           256
+#define SI5351_READ_CHUNK               32
+#define SI5351_WRITE_CHUNK              32
+#define SI5351_COMMIT_GAP               3
+#define SI5351_PLAN_CACHE_SIZE          16
+#define SI5351_MULTI_PLAN_MAX           3
+#define SI5351_SPUR_CLEAR_OFFSET        100000000ULL /* Hz * 100, fractional spurs further out are filtered by the PLL */
+#define SI5351_LOW_SPUR_MAX_ERROR       100000LL /* Micro-hertz */
+#define SI5351_FRAC_MS_MIN_ERROR        1000LL /* Micro-hertz, integer multisynth plans worse than this try a fractional one */
+#define SI5351_MULTISYNTH_FRAC_A_MIN    8 /* Smallest fractional multisynth divider */
+#define SI5351_JOINT_MS_DEN             1021 /* Multisynth fraction denominator in the joint search, prime */
+#define SI5351_JOINT_MS_STEPS           16 /* Multisynth fractions the joint search tries per divider */
+#define SI5351_JOINT_MS_TRIES           16 /* Multisynth dividers the joint search tries at most */
+#define SI5351_SYS_INIT_TIMEOUT_MS      100
+
 
 /* Macro definitions */
 
@@ -250,6 +269,10 @@ enum si5351_clock_fanout {SI5351_FANOUT_CLKIN, SI5351_FANOUT_XO, SI5351_FANOUT_M
 
 enum si5351_pll_input {SI5351_PLL_INPUT_XO, SI5351_PLL_INPUT_CLKIN};
 
+/* Best first: integer PLL and even integer multisynth, fractional PLL and
+   even integer multisynth, odd integer multisynth, fractional multisynth */
+enum si5351_jitter_class {SI5351_JITTER_INTEGER, SI5351_JITTER_EVEN_MS, SI5351_JITTER_ODD_MS, SI5351_JITTER_FRACTIONAL_MS};
+
 /* Struct definitions */
 
 struct Si5351RegSet
@@ -259,6 +282,54 @@ struct Si5351RegSet
 	uint32_t p3;
 };
 
+struct Si5351FreqPlan
+{
+	uint64_t freq;
+	uint64_t actual_freq;
+	int64_t error;
+	uint64_t pll_freq;
+	struct Si5351RegSet pll_reg;
+	struct Si5351RegSet ms_reg;
+	uint8_t r_div;
+	uint8_t int_mode;
+	uint8_t div_by_4;
+	uint8_t pll_int;
+	enum si5351_jitter_class jitter_class;
+	uint64_t spur_offset;
+	uint8_t pll_params[SI5351_PARAMETERS_LENGTH];
+	uint8_t ms_params[SI5351_PARAMETERS_LENGTH];
+};
+
+struct Si5351MultiPlan
+{
+	uint8_t count;
+	bool used[SI5351_MULTI_PLAN_MAX];
+	enum si5351_pll pll[SI5351_MULTI_PLAN_MAX];
+	struct Si5351FreqPlan out[SI5351_MULTI_PLAN_MAX];
+	uint64_t total_error;
+};
+
+struct Si5351BatchResult; /* See si5351_batch.h */
+
+struct Si5351OutputState
+{
+	uint8_t enabled;
+	enum si5351_drive drive;
+	uint8_t invert;
+	uint8_t power;
+	enum si5351_clock_source source;
+	enum si5351_clock_disable disable_state;
+};
+
+struct Si5351PlanCacheEntry
+{
+	bool valid;
+	uint64_t freq;
+	enum si5351_pll pll;
+	int32_t correction;
+	struct Si5351FreqPlan plan;
+};
+
 struct Si5351Status
 {
 	uint8_t SYS_INIT;
@@ -276,20 +347,72 @@ struct Si5351IntStatus
 	uint8_t LOS_STKY;
 };
 
+/* Bus definitions */
+
+/*
+ * Register-level transport used by the Si5351 class. The default on
+ * Arduino is Si5351WireBus on the global Wire instance; a host build can
+ * plug in Si5351Emulator (si5351_emu.h) or any other implementation.
+ *
+ * write() returns 0 on success, like Wire.endTransmission().
+ * read() returns the number of bytes actually read.
+ * probe() returns 0 if a device acknowledges the address.
+ * error_count() counts writes that failed after write() had already
+ * returned 0. Only transports that defer writes (Si5351AsyncBus) have
+ * any; the Si5351 class drops its register shadow when it goes up.
+ */
+class Si5351Bus
+{
+public:
+	virtual ~Si5351Bus() {}
+	virtual void begin(void) = 0;
+	virtual uint8_t probe(uint8_t dev_addr) = 0;
+	virtual uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t bytes, const uint8_t *data) = 0;
+	virtual uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data) = 0;
+	virtual uint32_t error_count(void) { return 0; }
+};
+
+#ifdef ARDUINO
+class Si5351WireBus : public Si5351Bus
+{
+public:
+	Si5351WireBus(TwoWire &wire_bus);
+	void begin(void);
+	uint8_t probe(uint8_t dev_addr);
+	uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t bytes, const uint8_t *data);
+	uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data);
+private:
+	TwoWire &wire;
+};
+#endif
+
 class Si5351
 {
 public:
-  Si5351(uint8_t i2c_addr = SI5351_BUS_BASE_ADDR);
+  Si5351(uint8_t i2c_addr = SI5351_BUS_BASE_ADDR, Si5351Bus *i2c_bus = NULL);
+	void set_bus(Si5351Bus *);
 	bool init(uint8_t, uint32_t, int32_t);
 	void reset(void);
 	uint8_t set_freq(uint64_t, enum si5351_clock);
 	uint8_t set_freq_manual(uint64_t, uint64_t, enum si5351_clock);
+	uint8_t calc_plan_exact(uint64_t, enum si5351_pll, struct Si5351FreqPlan *);
+	uint8_t calc_plan_low_spur(uint64_t, enum si5351_pll, int64_t, struct Si5351FreqPlan *);
+	uint32_t calc_plan_batch(const uint64_t *, uint32_t, enum si5351_pll, struct Si5351BatchResult *);
+	uint8_t set_freq_plan(const struct Si5351FreqPlan *, enum si5351_clock);
+	uint8_t plan_outputs(const uint64_t *, uint8_t, struct Si5351MultiPlan *);
+	uint8_t set_multi_plan(const struct Si5351MultiPlan *);
+	uint8_t calc_plan_cached(uint64_t, enum si5351_pll, struct Si5351FreqPlan *);
+	uint8_t set_freq_cached(uint64_t, enum si5351_clock);
+	uint8_t set_freq_fast(uint64_t, enum si5351_clock);
+	uint8_t calc_ms_image(uint64_t, enum si5351_pll, uint8_t *, int64_t *);
+	void clear_plan_cache(void);
 	void set_pll(uint64_t, enum si5351_pll);
 	void set_ms(enum si5351_clock, struct Si5351RegSet, uint8_t, uint8_t, uint8_t);
 	void output_enable(enum si5351_clock, uint8_t);
 	void drive_strength(enum si5351_clock, enum si5351_drive);
 	void update_status(void);
 	void set_correction(int32_t, enum si5351_pll_input);
+	uint8_t trim_correction(int32_t, enum si5351_pll_input);
 	void set_phase(enum si5351_clock, uint8_t);
 	int32_t get_correction(enum si5351_pll_input);
 	void pll_reset(enum si5351_pll);
@@ -299,6 +422,8 @@ public:
 	void set_clock_invert(enum si5351_clock, uint8_t);
 	void set_clock_source(enum si5351_clock, enum si5351_clock_source);
 	void set_clock_disable(enum si5351_clock, enum si5351_clock_disable);
+	void get_output_state(enum si5351_clock, struct Si5351OutputState *);
+	uint8_t set_output_state(enum si5351_clock, const struct Si5351OutputState *);
 	void set_clock_fanout(enum si5351_clock_fanout, uint8_t);
 	void set_pll_input(enum si5351_pll, enum si5351_pll_input);
 	void set_vcxo(uint64_t, uint8_t);
@@ -306,6 +431,10 @@ public:
 	uint8_t si5351_write_bulk(uint8_t, uint8_t, uint8_t *);
 	uint8_t si5351_write(uint8_t, uint8_t);
 	uint8_t si5351_read(uint8_t);
+	void begin_transaction(void);
+	uint8_t commit(void);
+	void sync_shadow(void);
+	void invalidate_shadow(void);
 	struct Si5351Status dev_status = {.SYS_INIT = 0, .LOL_B = 0, .LOL_A = 0,
     .LOS = 0, .REVID = 0};
 	struct Si5351IntStatus dev_int_status = {.SYS_INIT_STKY = 0, .LOL_B_STKY = 0,
@@ -318,18 +447,43 @@ public:
   enum si5351_pll_input pllb_ref_osc;
 	uint32_t xtal_freq[2];
 private:
+	uint8_t stage_freq(uint64_t, enum si5351_clock);
 	uint64_t pll_calc(enum si5351_pll, uint64_t, struct Si5351RegSet *, int32_t, uint8_t);
+	uint64_t corrected_ref_freq(enum si5351_pll, int32_t);
+	void pll_vco_exact(enum si5351_pll, uint64_t *, uint32_t *);
+	bool pll_in_use(enum si5351_pll);
+	void refresh_pll(enum si5351_pll);
+	void set_pll_int(enum si5351_pll, const struct Si5351RegSet *);
+	uint8_t ms_calc_exact(uint64_t, uint64_t, uint32_t, struct Si5351RegSet *, uint8_t *, int64_t *);
+	uint64_t plan_pll_group(const uint64_t *, const uint8_t *, uint8_t, enum si5351_pll, struct Si5351FreqPlan *);
 	uint64_t multisynth_calc(uint64_t, uint64_t, struct Si5351RegSet *);
 	uint64_t multisynth67_calc(uint64_t, uint64_t, struct Si5351RegSet *);
 	void update_sys_status(struct Si5351Status *);
 	void update_int_status(struct Si5351IntStatus *);
 	void ms_div(enum si5351_clock, uint8_t, uint8_t);
-	uint8_t select_r_div(uint64_t *);
 	uint8_t select_r_div_ms67(uint64_t *);
 	int32_t ref_correction[2];
   uint8_t clkin_div;
   uint8_t i2c_bus_addr;
+	Si5351Bus *bus;
   bool clk_first_set[8];
+	bool reg_cacheable(uint8_t);
+	bool reg_known(uint8_t);
+	void shadow_store(uint8_t, uint8_t);
+	uint8_t stage_write(uint8_t, uint8_t, uint8_t *);
+	bool reg_dirty_get(uint16_t);
+	uint8_t bus_write_bulk(uint8_t, uint8_t, uint8_t *);
+	uint8_t bus_read_bulk(uint8_t, uint8_t, uint8_t *);
+	void check_bus_errors(void);
+	uint8_t reg_shadow[SI5351_REGISTER_COUNT];
+	uint8_t reg_valid[SI5351_REGISTER_COUNT / 8];
+	uint8_t reg_dirty[SI5351_REGISTER_COUNT / 8];
+	uint8_t pending_pll_reset;
+	uint32_t bus_errors_seen;
+	uint8_t txn_depth;
+	uint8_t pll_stale;
+	struct Si5351PlanCacheEntry plan_cache[SI5351_PLAN_CACHE_SIZE];
+	uint8_t plan_cache_next;
 };
 
 #endif /* SI5351_H_ */
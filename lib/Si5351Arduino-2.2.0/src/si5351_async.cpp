@@ -0,0 +1,350 @@
+/*
+ * si5351_async.cpp - Queued Si5351 bus serviced by a FreeRTOS task
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+#include <stdint.h>
+#include <string.h>
+
+#include "si5351_async.h"
+
+Si5351AsyncBus::Si5351AsyncBus(Si5351Bus &inner_bus, UBaseType_t task_priority, BaseType_t task_core):
+	inner(inner_bus),
+	priority(task_priority),
+	core(task_core),
+	queue(NULL),
+	call_lock(NULL),
+	call_done(NULL),
+	task(NULL),
+	call_seq(0),
+	done_seq(0),
+	call_result(0),
+	write_status(0),
+	last_status(0),
+	errors(0)
+{
+}
+
+Si5351AsyncBus::~Si5351AsyncBus()
+{
+	if(task != NULL)
+	{
+		vTaskDelete(task);
+	}
+	if(queue != NULL)
+	{
+		vQueueDelete(queue);
+	}
+	if(call_lock != NULL)
+	{
+		vSemaphoreDelete(call_lock);
+	}
+	if(call_done != NULL)
+	{
+		vSemaphoreDelete(call_done);
+	}
+}
+
+/*
+ * begin(void)
+ *
+ * Start the wrapped bus and the service task. Later calls (e.g. from a
+ * second Si5351::init()) do nothing.
+ */
+void Si5351AsyncBus::begin(void)
+{
+	if(task != NULL)
+	{
+		return;
+	}
+
+	inner.begin();
+
+	queue = xQueueCreate(SI5351_ASYNC_QUEUE_LEN, sizeof(struct Si5351AsyncCmd));
+	call_lock = xSemaphoreCreateMutex();
+	call_done = xSemaphoreCreateBinary();
+	xTaskCreatePinnedToCore(service_task, "si5351", SI5351_ASYNC_STACK_SIZE, this, priority, &task, core);
+}
+
+uint8_t Si5351AsyncBus::probe(uint8_t dev_addr)
+{
+	if(task == NULL)
+	{
+		return inner.probe(dev_addr);
+	}
+
+	return call(SI5351_ASYNC_PROBE, dev_addr, 0, 0, NULL, SI5351_ASYNC_TIMEOUT_MS);
+}
+
+/*
+ * write(uint8_t dev_addr, uint8_t reg, uint8_t bytes, const uint8_t *data)
+ *
+ * Queue a register write and return without waiting for the bus.
+ *
+ * Returns 0 once queued, SI5351_ASYNC_ERR_TIMEOUT if the queue stayed full.
+ */
+uint8_t Si5351AsyncBus::write(uint8_t dev_addr, uint8_t reg, uint8_t bytes, const uint8_t *data)
+{
+	struct Si5351AsyncCmd cmd;
+
+	if(task == NULL)
+	{
+		return inner.write(dev_addr, reg, bytes, data);
+	}
+
+	cmd.op = SI5351_ASYNC_WRITE;
+	cmd.dev_addr = dev_addr;
+	cmd.callback = NULL;
+	cmd.arg = NULL;
+	cmd.seq = 0;
+
+	// Longer writes are split, auto-increment makes this equivalent
+	while(bytes > 0)
+	{
+		uint8_t len = bytes > SI5351_WRITE_CHUNK ? SI5351_WRITE_CHUNK : bytes;
+
+		cmd.reg = reg;
+		cmd.bytes = len;
+		memcpy(cmd.data, data, len);
+
+		if(xQueueSend(queue, &cmd, pdMS_TO_TICKS(SI5351_ASYNC_TIMEOUT_MS)) != pdTRUE)
+		{
+			return SI5351_ASYNC_ERR_TIMEOUT;
+		}
+
+		reg += len;
+		data += len;
+		bytes -= len;
+	}
+
+	return 0;
+}
+
+/*
+ * read(uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data)
+ *
+ * Read after every write queued so far, waiting at most
+ * SI5351_ASYNC_TIMEOUT_MS per chunk.
+ *
+ * Returns the number of bytes actually read.
+ */
+uint8_t Si5351AsyncBus::read(uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data)
+{
+	uint8_t total = 0;
+
+	if(task == NULL)
+	{
+		return inner.read(dev_addr, reg, bytes, data);
+	}
+
+	while(total < bytes)
+	{
+		uint8_t len = (bytes - total) > SI5351_READ_CHUNK ? SI5351_READ_CHUNK : (bytes - total);
+		uint8_t count = call(SI5351_ASYNC_READ, dev_addr, reg + total, len, data + total, SI5351_ASYNC_TIMEOUT_MS);
+
+		total += count;
+		if(count != len)
+		{
+			break;
+		}
+	}
+
+	return total;
+}
+
+/*
+ * fence(si5351_async_cb callback, void *arg)
+ *
+ * Queue a completion marker. callback runs on the service task once all
+ * writes queued before it have been sent, with the first non-zero Wire
+ * status seen since the previous fence (0 if all were acknowledged).
+ * Keep the callback short; it holds up the bus.
+ *
+ * Returns 0 once queued, SI5351_ASYNC_ERR_TIMEOUT if the queue stayed full.
+ */
+uint8_t Si5351AsyncBus::fence(si5351_async_cb callback, void *arg)
+{
+	struct Si5351AsyncCmd cmd;
+
+	if(task == NULL)
+	{
+		if(callback != NULL)
+		{
+			callback(0, arg);
+		}
+		return 0;
+	}
+
+	cmd.op = SI5351_ASYNC_FENCE;
+	cmd.bytes = 0;
+	cmd.seq = 0;
+	cmd.callback = callback;
+	cmd.arg = arg;
+
+	if(xQueueSend(queue, &cmd, pdMS_TO_TICKS(SI5351_ASYNC_TIMEOUT_MS)) != pdTRUE)
+	{
+		return SI5351_ASYNC_ERR_TIMEOUT;
+	}
+
+	return 0;
+}
+
+/*
+ * flush(uint32_t timeout_ms)
+ *
+ * Block until everything queued so far has been sent.
+ *
+ * Returns true if the queue drained within timeout_ms.
+ */
+bool Si5351AsyncBus::flush(uint32_t timeout_ms)
+{
+	if(task == NULL)
+	{
+		return true;
+	}
+
+	return call(SI5351_ASYNC_SYNC, 0, 0, 0, NULL, timeout_ms) == 0;
+}
+
+uint8_t Si5351AsyncBus::pending(void)
+{
+	return queue == NULL ? 0 : (uint8_t)uxQueueMessagesWaiting(queue);
+}
+
+uint8_t Si5351AsyncBus::last_error(void)
+{
+	return last_status;
+}
+
+uint32_t Si5351AsyncBus::error_count(void)
+{
+	return errors;
+}
+
+/*
+ * call(uint8_t op, uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data, uint32_t timeout_ms)
+ *
+ * Queue a command that returns a result and wait for it. Each call has a
+ * sequence number, so a late completion of a call that already timed out
+ * cannot be taken for the current one.
+ *
+ * Returns the command result: the byte count for reads, the Wire status
+ * for probes, 0 for syncs. A timeout gives 0 bytes for reads and
+ * SI5351_ASYNC_ERR_TIMEOUT otherwise.
+ */
+uint8_t Si5351AsyncBus::call(uint8_t op, uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data, uint32_t timeout_ms)
+{
+	struct Si5351AsyncCmd cmd;
+	uint8_t timeout_result = (op == SI5351_ASYNC_READ) ? 0 : SI5351_ASYNC_ERR_TIMEOUT;
+	TickType_t start = xTaskGetTickCount();
+	TickType_t limit = pdMS_TO_TICKS(timeout_ms);
+	uint8_t result = timeout_result;
+
+	if(xSemaphoreTake(call_lock, limit) != pdTRUE)
+	{
+		return timeout_result;
+	}
+
+	cmd.op = op;
+	cmd.dev_addr = dev_addr;
+	cmd.reg = reg;
+	cmd.bytes = bytes;
+	cmd.seq = ++call_seq;
+	cmd.callback = NULL;
+	cmd.arg = NULL;
+
+	if(xQueueSend(queue, &cmd, limit) == pdTRUE)
+	{
+		for(;;)
+		{
+			TickType_t elapsed = xTaskGetTickCount() - start;
+			if(elapsed >= limit || xSemaphoreTake(call_done, limit - elapsed) != pdTRUE)
+			{
+				break;
+			}
+
+			if(done_seq == cmd.seq)
+			{
+				result = call_result;
+				if(op == SI5351_ASYNC_READ)
+				{
+					memcpy(data, call_buf, result);
+				}
+				break;
+			}
+		}
+	}
+
+	xSemaphoreGive(call_lock);
+
+	return result;
+}
+
+void Si5351AsyncBus::service_task(void *arg)
+{
+	Si5351AsyncBus *self = static_cast<Si5351AsyncBus *>(arg);
+	struct Si5351AsyncCmd cmd;
+
+	for(;;)
+	{
+		if(xQueueReceive(self->queue, &cmd, portMAX_DELAY) == pdTRUE)
+		{
+			self->service(&cmd);
+		}
+	}
+}
+
+void Si5351AsyncBus::service(const struct Si5351AsyncCmd *cmd)
+{
+	uint8_t status;
+
+	switch(cmd->op)
+	{
+		case SI5351_ASYNC_WRITE:
+			status = inner.write(cmd->dev_addr, cmd->reg, cmd->bytes, cmd->data);
+			if(status != 0)
+			{
+				if(write_status == 0)
+				{
+					write_status = status;
+				}
+				last_status = status;
+				errors++;
+			}
+			break;
+		case SI5351_ASYNC_FENCE:
+			status = write_status;
+			write_status = 0;
+			if(cmd->callback != NULL)
+			{
+				cmd->callback(status, cmd->arg);
+			}
+			break;
+		case SI5351_ASYNC_READ:
+		case SI5351_ASYNC_PROBE:
+		case SI5351_ASYNC_SYNC:
+			if(cmd->op == SI5351_ASYNC_READ)
+			{
+				call_result = inner.read(cmd->dev_addr, cmd->reg, cmd->bytes, call_buf);
+			}
+			else if(cmd->op == SI5351_ASYNC_PROBE)
+			{
+				call_result = inner.probe(cmd->dev_addr);
+			}
+			else
+			{
+				call_result = 0;
+			}
+			done_seq = cmd->seq;
+			xSemaphoreGive(call_done);
+			break;
+	}
+}
+
+#endif /* ARDUINO_ARCH_ESP32 */
@@ -0,0 +1,94 @@
+/*
+ * si5351_async.h - Queued Si5351 bus serviced by a FreeRTOS task
+ *
+ * Si5351AsyncBus wraps another Si5351Bus (normally Si5351WireBus) and
+ * moves the I2C traffic onto its own task:
+ *
+ *   Si5351WireBus wire_bus(Wire);
+ *   Si5351AsyncBus async_bus(wire_bus);
+ *   Si5351 si5351(SI5351_BUS_BASE_ADDR, &async_bus);
+ *
+ * Writes are copied into a queue and return at once. Reads and probes
+ * are queued behind the writes so ordering is kept, and the caller waits
+ * for the result with a bounded timeout. Most driver reads come from the
+ * register shadow and never reach the bus, so in practice only status
+ * polling waits. Write failures are reported through fence() callbacks,
+ * last_error() and error_count(); the latter makes the Si5351 class
+ * discard its register shadow, since the device no longer matches it.
+ *
+ * Only built for ESP32 targets.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef SI5351_ASYNC_H_
+#define SI5351_ASYNC_H_
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "si5351.h"
+
+#define SI5351_ASYNC_QUEUE_LEN          32
+#define SI5351_ASYNC_TIMEOUT_MS         50
+#define SI5351_ASYNC_STACK_SIZE         2048
+#define SI5351_ASYNC_ERR_TIMEOUT        5   // Same code as Wire for a bus timeout
+
+typedef void (*si5351_async_cb)(uint8_t status, void *arg);
+
+class Si5351AsyncBus : public Si5351Bus
+{
+public:
+	Si5351AsyncBus(Si5351Bus &inner_bus, UBaseType_t task_priority = 2, BaseType_t task_core = tskNO_AFFINITY);
+	~Si5351AsyncBus();
+	void begin(void);
+	uint8_t probe(uint8_t dev_addr);
+	uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t bytes, const uint8_t *data);
+	uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data);
+	uint8_t fence(si5351_async_cb callback, void *arg);
+	bool flush(uint32_t timeout_ms = SI5351_ASYNC_TIMEOUT_MS);
+	uint8_t pending(void);
+	uint8_t last_error(void);
+	uint32_t error_count(void);
+private:
+	enum si5351_async_op {SI5351_ASYNC_WRITE, SI5351_ASYNC_READ, SI5351_ASYNC_PROBE, SI5351_ASYNC_SYNC, SI5351_ASYNC_FENCE};
+	struct Si5351AsyncCmd
+	{
+		uint8_t op;
+		uint8_t dev_addr;
+		uint8_t reg;
+		uint8_t bytes;
+		uint32_t seq;
+		si5351_async_cb callback;
+		void *arg;
+		uint8_t data[SI5351_WRITE_CHUNK];
+	};
+	static void service_task(void *);
+	void service(const struct Si5351AsyncCmd *);
+	uint8_t call(uint8_t op, uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data, uint32_t timeout_ms);
+	Si5351Bus &inner;
+	UBaseType_t priority;
+	BaseType_t core;
+	QueueHandle_t queue;
+	SemaphoreHandle_t call_lock;
+	SemaphoreHandle_t call_done;
+	TaskHandle_t task;
+	uint32_t call_seq;
+	volatile uint32_t done_seq;
+	uint8_t call_result;
+	uint8_t call_buf[SI5351_READ_CHUNK];
+	volatile uint8_t write_status;
+	volatile uint8_t last_status;
+	volatile uint32_t errors;
+};
+
+#endif /* ARDUINO_ARCH_ESP32 */
+
+#endif /* SI5351_ASYNC_H_ */
@@ -0,0 +1,129 @@
+/*
+ * si5351_batch.cpp - Evaluate many output frequencies at once
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "si5351_batch.h"
+#include "si5351_calc.h"
+
+/*
+ * si5351_plan_batch(const uint64_t *freq, uint32_t count, uint64_t ref_freq, int32_t correction, struct Si5351BatchResult *out)
+ *
+ * Plan every frequency in freq as si5351_plan_exact() would, against
+ * ref_freq corrected by correction parts-per-billion.
+ *
+ * The work is split in two passes per block of SI5351_BATCH_BLOCK
+ * candidates. The first does the clamping, R divider choice and
+ * multisynth range for the whole block with straight-line arithmetic
+ * on separate arrays, which the compiler turns into SIMD code. The
+ * second runs the divider search, whose continued fraction expansion
+ * is data dependent and stays scalar.
+ *
+ * freq - Array of output frequencies in Hz * 100
+ * count - Number of entries in freq and out
+ * ref_freq - Nominal reference frequency in Hz * 100
+ * correction - Calibration value in parts-per-billion, as for
+ *   Si5351::set_correction()
+ * out - Nearest achievable frequency, error in micro-hertz and the
+ *   PLL and multisynth register images for each entry. status is 0 on
+ *   success and 1 if the entry cannot be planned.
+ *
+ * Returns the number of entries that could not be planned.
+ */
+uint32_t si5351_plan_batch(const uint64_t *freq, uint32_t count, uint64_t ref_freq, int32_t correction, struct Si5351BatchResult *out)
+{
+	uint64_t freq_c[SI5351_BATCH_BLOCK];
+	uint64_t freq_r[SI5351_BATCH_BLOCK];
+	uint32_t ms_min[SI5351_BATCH_BLOCK];
+	uint32_t ms_max[SI5351_BATCH_BLOCK];
+	uint8_t r_div[SI5351_BATCH_BLOCK];
+	uint8_t div_by_4[SI5351_BATCH_BLOCK];
+	uint64_t ref = si5351_correct_ref(ref_freq, correction);
+	uint32_t failed = 0;
+
+	const uint64_t f_min = SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT;
+	const uint64_t f_max = SI5351_MULTISYNTH_MAX_FREQ * SI5351_FREQ_MULT;
+	const uint64_t f_div4 = SI5351_MULTISYNTH_DIVBY4_FREQ * SI5351_FREQ_MULT;
+	const double vco_min = (double)(SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT);
+	const double vco_max = (double)(SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT);
+
+	for(uint32_t base = 0; base < count; base += SI5351_BATCH_BLOCK)
+	{
+		uint32_t n = count - base < SI5351_BATCH_BLOCK ? count - base : SI5351_BATCH_BLOCK;
+		const uint64_t *f_in = freq + base;
+		uint32_t i;
+
+		// Pass 1: no branches and no 64-bit division, so it vectorizes
+		for(i = 0; i < n; i++)
+		{
+			uint64_t f = f_in[i];
+			f = f < f_min ? f_min : f;
+			f = f > f_max ? f_max : f;
+			freq_c[i] = f;
+
+			// One doubling for every octave below 128 * CLKOUT_MIN, as in
+			// si5351_select_r_div()
+			uint64_t shift = 0;
+			for(uint32_t k = 1; k <= 7; k++)
+			{
+				shift += (f < (f_min << k)) ? 1 : 0;
+			}
+			freq_r[i] = f << shift;
+			r_div[i] = (uint8_t)shift;
+		}
+
+		for(i = 0; i < n; i++)
+		{
+			// freq_r is below 2^35, so it converts exactly in two signed
+			// 32-bit halves (plain SIMD conversions, unlike uint64_t). The
+			// quotients are at least 1 / freq_r away from an integer, far
+			// more than a double rounds, so ceil() and floor() are exact.
+			double fr = (double)(int32_t)(freq_r[i] >> 16) * 65536.0 + (double)(int32_t)(freq_r[i] & 0xFFFF);
+			double lo = ceil(vco_min / fr);
+			double hi = floor(vco_max / fr);
+			int32_t d4 = freq_r[i] >= f_div4;
+
+			lo = lo < SI5351_MULTISYNTH_A_MIN ? SI5351_MULTISYNTH_A_MIN : lo;
+			hi = hi > SI5351_MULTISYNTH_A_MAX ? SI5351_MULTISYNTH_A_MAX : hi;
+			ms_min[i] = d4 ? 4 : (uint32_t)(int32_t)lo;
+			ms_max[i] = d4 ? 4 : (uint32_t)(int32_t)hi;
+			div_by_4[i] = (uint8_t)d4;
+		}
+
+		// Pass 2: divider search, one candidate at a time
+		for(i = 0; i < n; i++)
+		{
+			struct Si5351FreqPlan plan = {};
+			struct Si5351BatchResult *res = &out[base + i];
+
+			plan.freq = freq_c[i];
+			plan.r_div = r_div[i];
+			plan.div_by_4 = div_by_4[i];
+
+			if(ms_min[i] > ms_max[i] || si5351_plan_solve(&plan, freq_r[i], ms_min[i], ms_max[i], ref) != 0)
+			{
+				memset(res, 0, sizeof(*res));
+				res->status = 1;
+				failed++;
+				continue;
+			}
+
+			res->actual_freq = plan.actual_freq;
+			res->error = plan.error;
+			memcpy(res->pll_params, plan.pll_params, SI5351_PARAMETERS_LENGTH);
+			memcpy(res->ms_params, plan.ms_params, SI5351_PARAMETERS_LENGTH);
+			res->int_mode = plan.int_mode;
+			res->status = 0;
+		}
+	}
+
+	return failed;
+}
@@ -0,0 +1,39 @@
+/*
+ * si5351_batch.h - Evaluate many output frequencies at once
+ *
+ * si5351_plan_batch() runs the exact single-output planner over an
+ * array of target frequencies for one reference and calibration value,
+ * and reports for each the nearest frequency the device can make, the
+ * error and the register images. It has no device or Arduino
+ * dependencies, so the same tables can be built on a PC or on the
+ * target, e.g. to pick channel frequencies that synthesize exactly.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef SI5351_BATCH_H_
+#define SI5351_BATCH_H_
+
+#include <stdint.h>
+
+#include "si5351.h"
+
+/* Candidates prepared per pass; sized so the scratch arrays stay in L1 */
+#define SI5351_BATCH_BLOCK              256
+
+struct Si5351BatchResult
+{
+	uint64_t actual_freq;
+	int64_t error;
+	uint8_t pll_params[SI5351_PARAMETERS_LENGTH];
+	uint8_t ms_params[SI5351_PARAMETERS_LENGTH];
+	uint8_t int_mode;
+	uint8_t status;
+};
+
+uint32_t si5351_plan_batch(const uint64_t *freq, uint32_t count, uint64_t ref_freq, int32_t correction, struct Si5351BatchResult *out);
+
+#endif /* SI5351_BATCH_H_ */
@@ -0,0 +1,864 @@
+/*
+ * si5351_calc.h - Si5351 divider math usable at compile time
+ *
+ * The exact PLL and multisynth solver behind Si5351::calc_plan_exact(),
+ * written as constexpr functions. The driver calls them at run time and
+ * a sketch can evaluate them at compile time for frequencies it already
+ * knows, e.g.
+ *
+ *   constexpr struct Si5351FreqPlan plan = si5351_make_plan(1409710000ULL);
+ *   static_assert(si5351_plan_check(plan, SI5351_XTAL_FREQ * SI5351_FREQ_MULT), "");
+ *
+ * The resulting register images live in flash and can be written with
+ * Si5351::set_freq_plan(). They assume the reference they were solved
+ * for, so a sketch must fall back to the run time solver once a
+ * calibration correction is in use. Needs C++14 or later.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef SI5351_CALC_H_
+#define SI5351_CALC_H_
+
+#include "si5351.h"
+
+/*
+ * si5351_correct_ref(uint64_t ref_freq, int32_t correction)
+ *
+ * Reference frequency (Hz * 100) with a parts-per-billion calibration
+ * value factored in, as the driver applies it.
+ */
+constexpr uint64_t si5351_correct_ref(uint64_t ref_freq, int32_t correction)
+{
+	return ref_freq + (int32_t)((((((int64_t)correction) << 31) / 1000000000LL) * ref_freq) >> 31);
+}
+
+/*
+ * si5351_select_r_div(uint64_t *freq)
+ *
+ * R divider needed to bring freq (Hz * 100) up into the multisynth
+ * range. freq is multiplied by the chosen ratio.
+ */
+constexpr uint8_t si5351_select_r_div(uint64_t *freq)
+{
+	uint8_t r_div = SI5351_OUTPUT_CLK_DIV_1;
+
+	// Choose the correct R divider
+	if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 2))
+	{
+		r_div = SI5351_OUTPUT_CLK_DIV_128;
+		*freq *= 128ULL;
+	}
+	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 2) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 4))
+	{
+		r_div = SI5351_OUTPUT_CLK_DIV_64;
+		*freq *= 64ULL;
+	}
+	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 4) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 8))
+	{
+		r_div = SI5351_OUTPUT_CLK_DIV_32;
+		*freq *= 32ULL;
+	}
+	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 8) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 16))
+	{
+		r_div = SI5351_OUTPUT_CLK_DIV_16;
+		*freq *= 16ULL;
+	}
+	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 16) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 32))
+	{
+		r_div = SI5351_OUTPUT_CLK_DIV_8;
+		*freq *= 8ULL;
+	}
+	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 32) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 64))
+	{
+		r_div = SI5351_OUTPUT_CLK_DIV_4;
+		*freq *= 4ULL;
+	}
+	else if((*freq >= SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 64) && (*freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT * 128))
+	{
+		r_div = SI5351_OUTPUT_CLK_DIV_2;
+		*freq *= 2ULL;
+	}
+
+	return r_div;
+}
+
+/*
+ * si5351_rational_approx_t(T num, T den, uint32_t max_den, uint32_t *best_num, uint32_t *best_den)
+ *
+ * Body of si5351_rational_approx(), with the remainders held in T so
+ * that the divisions can be done at the narrowest width that fits.
+ */
+template <typename T>
+constexpr void si5351_rational_approx_t(T num, T den, uint32_t max_den, uint32_t *best_num, uint32_t *best_den)
+{
+	T n = num;
+	T d = den;
+	uint64_t n0 = 0, d0 = 1, n1 = 1, d1 = 0;
+
+	while(d != 0)
+	{
+		T dp = d;
+		T a = n / d;
+		d = n % d;
+		n = dp;
+
+		uint64_t n2 = n0 + (uint64_t)a * n1;
+		uint64_t d2 = d0 + (uint64_t)a * d1;
+
+		if(d2 > max_den)
+		{
+			uint32_t t = (uint32_t)(max_den - d0) / (uint32_t)d1;
+
+			// Take the semi-convergent if it beats the previous convergent
+			if(2 * (uint64_t)t > a || (2 * (uint64_t)t == a && d0 * dp > d1 * d))
+			{
+				n1 = n0 + t * n1;
+				d1 = d0 + t * d1;
+			}
+			break;
+		}
+
+		n0 = n1;
+		d0 = d1;
+		n1 = n2;
+		d1 = d2;
+	}
+
+	*best_num = (uint32_t)n1;
+	*best_den = (uint32_t)d1;
+}
+
+/*
+ * si5351_rational_approx(uint64_t num, uint64_t den, uint32_t max_den, uint32_t *best_num, uint32_t *best_den)
+ *
+ * Closest fraction best_num/best_den to num/den with best_den <= max_den,
+ * found by walking the continued fraction expansion (Stern-Brocot tree)
+ * and checking the last semi-convergent. Derived from
+ * rational_best_approximation() in the Linux kernel.
+ *
+ * PLL ratios have den equal to the reference, which fits in 32 bits for
+ * any crystal below 42.9 MHz; those run on 32-bit divisions, which are
+ * done in hardware on 32-bit MCUs and are several times cheaper on a PC.
+ */
+constexpr void si5351_rational_approx(uint64_t num, uint64_t den, uint32_t max_den, uint32_t *best_num, uint32_t *best_den)
+{
+	if(den <= UINT32_MAX && num <= UINT32_MAX)
+	{
+		si5351_rational_approx_t<uint32_t>((uint32_t)num, (uint32_t)den, max_den, best_num, best_den);
+	}
+	else
+	{
+		si5351_rational_approx_t<uint64_t>(num, den, max_den, best_num, best_den);
+	}
+}
+
+/*
+ * si5351_pll_calc_exact(uint64_t ref_freq, uint64_t vco_freq, struct Si5351RegSet *reg, uint64_t *vco_num, uint32_t *vco_den)
+ *
+ * Feedback divider a + b/c closest to vco_freq / ref_freq, using the
+ * full 20-bit denominator range. The achieved VCO frequency is returned
+ * as the exact fraction vco_num / vco_den in Hz * 100.
+ */
+constexpr void si5351_pll_calc_exact(uint64_t ref_freq, uint64_t vco_freq, struct Si5351RegSet *reg, uint64_t *vco_num, uint32_t *vco_den)
+{
+	uint32_t a = vco_freq / ref_freq;
+	uint32_t b = 0, c = 1;
+
+	si5351_rational_approx(vco_freq % ref_freq, ref_freq, SI5351_PLL_C_MAX, &b, &c);
+
+	if(b == c)
+	{
+		a++;
+		b = 0;
+	}
+	if(b == 0)
+	{
+		c = 1;
+	}
+
+	reg->p1 = 128 * a + ((128 * b) / c) - 512;
+	reg->p2 = 128 * b - c * ((128 * b) / c);
+	reg->p3 = c;
+
+	*vco_num = ref_freq * ((uint64_t)a * c + b);
+	*vco_den = c;
+}
+
+/*
+ * si5351_pack_regset(const struct Si5351RegSet *reg, uint8_t *params)
+ *
+ * Lay out P1/P2/P3 in the 8-byte order shared by the PLL (26-41) and
+ * multisynth (42-89) parameter blocks. params must hold at least
+ * SI5351_PARAMETERS_LENGTH bytes. Bits outside P1[17:16] in the third
+ * byte are left clear for the caller to fill in.
+ */
+constexpr void si5351_pack_regset(const struct Si5351RegSet *reg, uint8_t *params)
+{
+	// Registers 26-27 / 42-43
+	params[0] = (uint8_t)((reg->p3 >> 8) & 0xFF);
+	params[1] = (uint8_t)(reg->p3 & 0xFF);
+
+	// Register 28 / 44
+	params[2] = (uint8_t)((reg->p1 >> 16) & 0x03);
+
+	// Registers 29-30 / 45-46
+	params[3] = (uint8_t)((reg->p1 >> 8) & 0xFF);
+	params[4] = (uint8_t)(reg->p1 & 0xFF);
+
+	// Register 31 / 47
+	params[5] = (uint8_t)((reg->p3 >> 12) & 0xF0);
+	params[5] += (uint8_t)((reg->p2 >> 16) & 0x0F);
+
+	// Registers 32-33 / 48-49
+	params[6] = (uint8_t)((reg->p2 >> 8) & 0xFF);
+	params[7] = (uint8_t)(reg->p2 & 0xFF);
+}
+
+/*
+ * si5351_ms_range(uint64_t freq_r, uint32_t *ms_min, uint32_t *ms_max)
+ *
+ * Integer multisynth dividers that keep the VCO in range for freq_r,
+ * the output frequency ahead of the R divider (Hz * 100). Above the
+ * DIVBY4 threshold the only choice is 4.
+ *
+ * Returns 0 on success, 1 if no divider fits.
+ */
+constexpr uint8_t si5351_ms_range(uint64_t freq_r, uint32_t *ms_min, uint32_t *ms_max)
+{
+	if(freq_r >= SI5351_MULTISYNTH_DIVBY4_FREQ * SI5351_FREQ_MULT)
+	{
+		*ms_min = 4;
+		*ms_max = 4;
+		return 0;
+	}
+
+	*ms_min = ((SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT) + freq_r - 1) / freq_r;
+	*ms_max = (SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT) / freq_r;
+
+	if(*ms_min < SI5351_MULTISYNTH_A_MIN)
+	{
+		*ms_min = SI5351_MULTISYNTH_A_MIN;
+	}
+	if(*ms_max > SI5351_MULTISYNTH_A_MAX)
+	{
+		*ms_max = SI5351_MULTISYNTH_A_MAX;
+	}
+
+	return *ms_min > *ms_max ? 1 : 0;
+}
+
+/*
+ * si5351_plan_grade(struct Si5351FreqPlan *plan, uint64_t ref_freq)
+ *
+ * Fill in the integer mode flags, jitter class and spur offset of a
+ * plan from its PLL and multisynth P1/P2/P3. A divider a + b/c is an
+ * integer exactly when P2 is 0 and P1 + 512 is a multiple of 128.
+ * Integer mode is only set for even multisynth dividers, as the
+ * datasheet requires. spur_offset is the distance (Hz * 100) of the VCO
+ * from the nearest integer multiple of the reference, which is where
+ * the fractional PLL puts its strongest spur; 0 for an integer PLL.
+ */
+constexpr void si5351_plan_grade(struct Si5351FreqPlan *plan, uint64_t ref_freq)
+{
+	const struct Si5351RegSet &pll = plan->pll_reg;
+	const struct Si5351RegSet &ms = plan->ms_reg;
+	bool ms_int = plan->div_by_4 || (ms.p2 == 0 && (ms.p1 + 512) % 128 == 0);
+	bool ms_even = plan->div_by_4 || (ms_int && ((ms.p1 + 512) / 128) % 2 == 0);
+
+	plan->pll_int = (pll.p2 == 0 && (pll.p1 + 512) % 128 == 0) ? 1 : 0;
+	plan->int_mode = ms_even ? 1 : 0;
+
+	if(!ms_int)
+	{
+		plan->jitter_class = SI5351_JITTER_FRACTIONAL_MS;
+	}
+	else if(!ms_even)
+	{
+		plan->jitter_class = SI5351_JITTER_ODD_MS;
+	}
+	else
+	{
+		plan->jitter_class = plan->pll_int ? SI5351_JITTER_INTEGER : SI5351_JITTER_EVEN_MS;
+	}
+
+	// Fractional part of the feedback ratio is rem / den
+	uint64_t num = (uint64_t)pll.p3 * (pll.p1 + 512) + pll.p2;
+	uint64_t den = 128ULL * pll.p3;
+	uint64_t rem = den ? num % den : 0;
+	uint64_t dist = rem < den - rem ? rem : den - rem;
+
+	plan->spur_offset = den ? (ref_freq * dist) / den : 0;
+}
+
+/*
+ * si5351_jitter_score(const struct Si5351FreqPlan &plan)
+ *
+ * Single figure of merit for a graded plan, lower is better. The
+ * thousands are the jitter class; within a class a fractional PLL whose
+ * boundary spur falls inside SI5351_SPUR_CLEAR_OFFSET adds up to 999.
+ */
+constexpr uint16_t si5351_jitter_score(const struct Si5351FreqPlan &plan)
+{
+	uint16_t score = (uint16_t)plan.jitter_class * 1000;
+
+	if(!plan.pll_int && plan.spur_offset < SI5351_SPUR_CLEAR_OFFSET)
+	{
+		score += (uint16_t)(999 - (plan.spur_offset * 999) / SI5351_SPUR_CLEAR_OFFSET);
+	}
+
+	return score;
+}
+
+/*
+ * si5351_plan_pack(struct Si5351FreqPlan *plan)
+ *
+ * Register images of a plan, ready to be blitted by set_freq_plan().
+ */
+constexpr void si5351_plan_pack(struct Si5351FreqPlan *plan)
+{
+	si5351_pack_regset(&plan->pll_reg, plan->pll_params);
+	si5351_pack_regset(&plan->ms_reg, plan->ms_params);
+	plan->ms_params[2] |= (plan->r_div << SI5351_OUTPUT_CLK_DIV_SHIFT);
+	if(plan->div_by_4)
+	{
+		plan->ms_params[2] |= SI5351_OUTPUT_CLK_DIVBY4;
+	}
+}
+
+/*
+ * si5351_plan_frac_ms(struct Si5351FreqPlan *plan, uint64_t freq_r, uint64_t ref_freq, uint64_t *best_err)
+ *
+ * Second stage of si5351_plan_solve(): every integer PLL feedback
+ * divider that keeps the VCO in range, paired with the best 20-bit
+ * rational multisynth divider of at least SI5351_MULTISYNTH_FRAC_A_MIN.
+ * Fractional dividers on both sides multiply the achievable ratios, so
+ * this reaches frequencies that no integer multisynth can hit closely.
+ * plan is only replaced by a candidate with less than *best_err error
+ * (micro-hertz), which is then updated.
+ *
+ * Returns true if plan was replaced.
+ */
+constexpr bool si5351_plan_frac_ms(struct Si5351FreqPlan *plan, uint64_t freq_r, uint64_t ref_freq, uint64_t *best_err)
+{
+	uint64_t r = freq_r / plan->freq;
+	uint64_t a_min = (SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT + ref_freq - 1) / ref_freq;
+	uint64_t a_max = (SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT) / ref_freq;
+	bool replaced = false;
+
+	if(a_min < SI5351_PLL_A_MIN)
+	{
+		a_min = SI5351_PLL_A_MIN;
+	}
+	if(a_max > SI5351_PLL_A_MAX)
+	{
+		a_max = SI5351_PLL_A_MAX;
+	}
+
+	for(uint64_t a = a_min; a <= a_max; a++)
+	{
+		uint64_t vco = ref_freq * a;
+		uint64_t m = vco / freq_r;
+		uint32_t b = 0, c = 1;
+
+		si5351_rational_approx(vco % freq_r, freq_r, SI5351_MULTISYNTH_C_MAX, &b, &c);
+		if(b == c)
+		{
+			m++;
+			b = 0;
+		}
+		if(b == 0)
+		{
+			c = 1;
+		}
+		if(m < SI5351_MULTISYNTH_FRAC_A_MIN || m > SI5351_MULTISYNTH_A_MAX || (m == SI5351_MULTISYNTH_A_MAX && b != 0))
+		{
+			continue;
+		}
+
+		// Output ahead of R is vco * c / (m * c + b)
+		uint64_t div_num = m * c + b;
+		uint64_t out_scaled = vco * c;
+		uint64_t target_scaled = freq_r * div_num;
+		uint64_t err = out_scaled > target_scaled ? out_scaled - target_scaled : target_scaled - out_scaled;
+		uint64_t err_den = div_num * r;
+		uint64_t err_uhz = (err * 10000ULL + err_den / 2) / err_den;
+
+		if(err_uhz >= *best_err)
+		{
+			continue;
+		}
+
+		*best_err = err_uhz;
+		replaced = true;
+
+		plan->pll_reg.p1 = (uint32_t)(128 * a - 512);
+		plan->pll_reg.p2 = 0;
+		plan->pll_reg.p3 = 1;
+		plan->pll_freq = vco;
+		plan->actual_freq = (out_scaled + err_den / 2) / err_den;
+		plan->error = out_scaled >= target_scaled ? (int64_t)err_uhz : -(int64_t)err_uhz;
+		plan->ms_reg.p1 = (uint32_t)(128 * m + ((128 * (uint64_t)b) / c) - 512);
+		plan->ms_reg.p2 = (uint32_t)(128 * (uint64_t)b - c * ((128 * (uint64_t)b) / c));
+		plan->ms_reg.p3 = c;
+
+		if(err_uhz == 0)
+		{
+			break;
+		}
+	}
+
+	return replaced;
+}
+
+/*
+ * si5351_plan_joint(struct Si5351FreqPlan *plan, uint64_t freq_r, uint32_t ms_min, uint32_t ms_max, uint64_t ref_freq, uint64_t *best_err)
+ *
+ * Last stage of si5351_plan_solve(), for outputs sitting just off a
+ * simple fraction of the reference (e.g. 90000000.29 Hz from 25 MHz),
+ * where neither a fractional PLL on an integer multisynth nor the
+ * reverse can get close. The multisynth gets a fraction b2 / c2 with
+ * c2 = SI5351_JOINT_MS_DEN, a prime, and the PLL the best 20-bit ratio
+ * for it. The combined ratio then has a large denominator, so the PLL
+ * fraction can resolve the offset. SI5351_JOINT_MS_STEPS fractions
+ * spread over each divider from ms_min (at least
+ * SI5351_MULTISYNTH_FRAC_A_MIN) are tried, for at most
+ * SI5351_JOINT_MS_TRIES dividers, stopping at the first candidate within
+ * a tenth of SI5351_FRAC_MS_MIN_ERROR. Same contract as
+ * si5351_plan_frac_ms().
+ *
+ * Returns true if plan was replaced.
+ */
+constexpr bool si5351_plan_joint(struct Si5351FreqPlan *plan, uint64_t freq_r, uint32_t ms_min, uint32_t ms_max, uint64_t ref_freq, uint64_t *best_err)
+{
+	const uint64_t c2 = SI5351_JOINT_MS_DEN;
+	uint64_t r = freq_r / plan->freq;
+	uint64_t pll_den = c2 * ref_freq;
+
+	if(ms_min < SI5351_MULTISYNTH_FRAC_A_MIN)
+	{
+		ms_min = SI5351_MULTISYNTH_FRAC_A_MIN;
+	}
+	if(ms_max > ms_min + SI5351_JOINT_MS_TRIES - 1)
+	{
+		ms_max = ms_min + SI5351_JOINT_MS_TRIES - 1;
+	}
+
+	bool replaced = false;
+	for(uint64_t m = ms_min; m <= ms_max; m++)
+	{
+		for(uint64_t k = 0; k < SI5351_JOINT_MS_STEPS; k++)
+		{
+			// PLL ratio wanted is a + rem / pll_den = freq_r * n / pll_den
+			uint64_t b2 = 1 + (k * (c2 - 1)) / SI5351_JOINT_MS_STEPS;
+			uint64_t n = m * c2 + b2;
+			uint64_t pll_num = freq_r * n;
+			uint64_t a = pll_num / pll_den;
+			uint64_t rem = pll_num % pll_den;
+			uint32_t b1 = 0, c1 = 1;
+
+			if(a < SI5351_PLL_A_MIN || a >= SI5351_PLL_A_MAX)
+			{
+				continue;
+			}
+
+			si5351_rational_approx(rem, pll_den, SI5351_PLL_C_MAX, &b1, &c1);
+
+			uint64_t vco = ref_freq * a + (ref_freq * b1) / c1;
+			if(vco < SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT || vco > SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT)
+			{
+				continue;
+			}
+
+			// Output error is (b1 / c1 - rem / pll_den) / (a + rem / pll_den)
+			// of freq, i.e. err / err_den in Hz * 100
+			uint64_t got = (uint64_t)b1 * pll_den;
+			uint64_t want = rem * c1;
+			uint64_t err = got > want ? got - want : want - got;
+			uint64_t err_den = (uint64_t)c1 * n * r;
+			uint64_t err_uhz = (err * 10000ULL + err_den / 2) / err_den;
+
+			if(err_uhz >= *best_err)
+			{
+				continue;
+			}
+
+			*best_err = err_uhz;
+			replaced = true;
+
+			if(b1 == c1)
+			{
+				a++;
+				b1 = 0;
+			}
+			if(b1 == 0)
+			{
+				c1 = 1;
+			}
+			plan->pll_reg.p1 = (uint32_t)(128 * a + ((128 * (uint64_t)b1) / c1) - 512);
+			plan->pll_reg.p2 = (uint32_t)(128 * (uint64_t)b1 - c1 * ((128 * (uint64_t)b1) / c1));
+			plan->pll_reg.p3 = c1;
+			plan->pll_freq = vco;
+			plan->actual_freq = got >= want ? plan->freq + (err + err_den / 2) / err_den : plan->freq - (err + err_den / 2) / err_den;
+			plan->error = got >= want ? (int64_t)err_uhz : -(int64_t)err_uhz;
+			plan->ms_reg.p1 = (uint32_t)(128 * m + ((128 * b2) / c2) - 512);
+			plan->ms_reg.p2 = (uint32_t)(128 * b2 - c2 * ((128 * b2) / c2));
+			plan->ms_reg.p3 = (uint32_t)c2;
+
+			if(err_uhz <= SI5351_FRAC_MS_MIN_ERROR / 10)
+			{
+				return true;
+			}
+		}
+	}
+
+	return replaced;
+}
+
+/*
+ * si5351_plan_solve(struct Si5351FreqPlan *plan, uint64_t freq_r, uint32_t ms_min, uint32_t ms_max, uint64_t ref_freq)
+ *
+ * Divider search behind si5351_plan_exact(), for a plan whose freq,
+ * r_div and div_by_4 are already set and whose output ahead of the R
+ * divider is freq_r. Every integer multisynth divider from ms_min to
+ * ms_max is tried, even ones first, and the PLL takes the fractional
+ * part. If the best of those is still more than SI5351_FRAC_MS_MIN_ERROR
+ * off and the VCO range allows a fractional multisynth, the search goes
+ * on with si5351_plan_frac_ms() and then si5351_plan_joint(). Integer
+ * multisynth plans are kept whenever they are close enough, since they
+ * jitter less.
+ *
+ * Returns 0 on success, 1 if no divider fits.
+ */
+constexpr uint8_t si5351_plan_solve(struct Si5351FreqPlan *plan, uint64_t freq_r, uint32_t ms_min, uint32_t ms_max, uint64_t ref_freq)
+{
+	uint64_t freq = plan->freq;
+	bool found = false;
+	uint64_t best_err = 0;
+
+	// Even dividers first so that they win ties against odd ones
+	for(uint8_t pass = 0; pass < 2 && !(found && best_err == 0); pass++)
+	{
+		for(uint32_t ms = ms_min + ((ms_min & 0x01) ^ pass); ms <= ms_max; ms += 2)
+		{
+			struct Si5351RegSet pll_reg = {0, 0, 0};
+			uint64_t vco_num = 0;
+			uint32_t vco_den = 1;
+			uint64_t target = freq_r * ms;
+
+			si5351_pll_calc_exact(ref_freq, target, &pll_reg, &vco_num, &vco_den);
+
+			// Output error is err / err_den in Hz * 100
+			uint64_t target_scaled = target * vco_den;
+			uint64_t err = vco_num > target_scaled ? vco_num - target_scaled : target_scaled - vco_num;
+			uint64_t err_den = (uint64_t)vco_den * ms * (freq_r / freq);
+			uint64_t err_uhz = (err * 10000ULL + err_den / 2) / err_den;
+
+			if(!found || err_uhz < best_err)
+			{
+				found = true;
+				best_err = err_uhz;
+
+				plan->pll_reg = pll_reg;
+				plan->pll_freq = vco_num / vco_den;
+				plan->actual_freq = (vco_num + err_den / 2) / err_den;
+				plan->error = vco_num >= target_scaled ? (int64_t)err_uhz : -(int64_t)err_uhz;
+
+				if(plan->div_by_4)
+				{
+					plan->ms_reg.p1 = 0;
+				}
+				else
+				{
+					plan->ms_reg.p1 = 128 * ms - 512;
+				}
+				plan->ms_reg.p2 = 0;
+				plan->ms_reg.p3 = 1;
+
+				if(best_err == 0)
+				{
+					break;
+				}
+			}
+		}
+	}
+
+	if(!found)
+	{
+		return 1;
+	}
+
+	if(best_err > SI5351_FRAC_MS_MIN_ERROR && !plan->div_by_4 && ms_max >= SI5351_MULTISYNTH_FRAC_A_MIN)
+	{
+		si5351_plan_frac_ms(plan, freq_r, ref_freq, &best_err);
+		if(best_err > SI5351_FRAC_MS_MIN_ERROR)
+		{
+			si5351_plan_joint(plan, freq_r, ms_min, ms_max, ref_freq, &best_err);
+		}
+	}
+
+	si5351_plan_grade(plan, ref_freq);
+	si5351_plan_pack(plan);
+
+	return 0;
+}
+
+/*
+ * si5351_plan_exact(uint64_t freq, uint64_t ref_freq, struct Si5351FreqPlan *plan)
+ *
+ * Exact single-output plan against a reference of ref_freq (Hz * 100).
+ * Every integer multisynth divider that keeps the VCO in range is tried,
+ * even ones first, and the PLL takes the fractional part; see
+ * si5351_plan_solve() for when a fractional multisynth is used instead.
+ *
+ * The error left depends on how much freedom the dividers have. Below
+ * 112 MHz the fractional multisynth stages keep it within
+ * SI5351_FRAC_MS_MIN_ERROR (1 mHz). From there to 900 MHz / 8 the VCO
+ * leaves no room above a multisynth of 8, and above that the multisynth
+ * can only be 4 (DIVBY4), 6 or 7, so the 20-bit PLL fraction alone sets
+ * the output. Most frequencies still land within a few mHz, but one just
+ * off a simple fraction of the reference can only get as close as the
+ * PLL's finest step allows: ref / SI5351_PLL_C_MAX at the VCO, which is
+ * 23.8 Hz and, through DIVBY4, 5.96 Hz at the output. Such frequencies
+ * can be up to half that, about 3 Hz, off (150000002.98 Hz: 2.98 Hz,
+ * 193750001.10 Hz: 1.1 Hz, 152083334 Hz: 0.67 Hz).
+ * extras/host/exact_bench.cpp measures both ranges, including those
+ * near-fraction frequencies.
+ *
+ * Returns 0 on success, 1 if no divider fits.
+ */
+constexpr uint8_t si5351_plan_exact(uint64_t freq, uint64_t ref_freq, struct Si5351FreqPlan *plan)
+{
+	uint64_t freq_r = 0;
+	uint32_t ms_min = 0, ms_max = 0;
+
+	// Same bounds as set_freq() for MS0 through MS5
+	if(freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT)
+	{
+		freq = SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT;
+	}
+	if(freq > SI5351_MULTISYNTH_MAX_FREQ * SI5351_FREQ_MULT)
+	{
+		freq = SI5351_MULTISYNTH_MAX_FREQ * SI5351_FREQ_MULT;
+	}
+
+	plan->freq = freq;
+	freq_r = freq;
+	plan->r_div = si5351_select_r_div(&freq_r);
+
+	// DIVBY4 mode pins the VCO to four times the output
+	plan->div_by_4 = (freq_r >= SI5351_MULTISYNTH_DIVBY4_FREQ * SI5351_FREQ_MULT) ? 1 : 0;
+	if(si5351_ms_range(freq_r, &ms_min, &ms_max) != 0)
+	{
+		return 1;
+	}
+
+	return si5351_plan_solve(plan, freq_r, ms_min, ms_max, ref_freq);
+}
+
+/*
+ * si5351_plan_low_spur(uint64_t freq, uint64_t ref_freq, int64_t max_error, struct Si5351FreqPlan *plan)
+ *
+ * Plan that trades a bounded frequency error for lower jitter and
+ * spurs. Every integer multisynth divider is paired with both the exact
+ * fractional PLL ratio and the nearest integer one, and the candidate
+ * with the lowest si5351_jitter_score() whose error stays within
+ * max_error (micro-hertz) wins, the smaller error breaking ties. Falls
+ * back to the si5351_plan_exact() result when nothing else qualifies.
+ *
+ * Returns 0 on success, 1 if no divider fits.
+ */
+constexpr uint8_t si5351_plan_low_spur(uint64_t freq, uint64_t ref_freq, int64_t max_error, struct Si5351FreqPlan *plan)
+{
+	if(si5351_plan_exact(freq, ref_freq, plan) != 0)
+	{
+		return 1;
+	}
+
+	struct Si5351FreqPlan best = *plan;
+	uint16_t best_score = si5351_jitter_score(best);
+	uint64_t freq_r = plan->freq;
+	uint32_t ms_min = 0, ms_max = 0;
+
+	if(best.error > max_error || best.error < -max_error)
+	{
+		return 0;
+	}
+
+	si5351_select_r_div(&freq_r);
+	si5351_ms_range(freq_r, &ms_min, &ms_max);
+
+	for(uint32_t ms = ms_min; ms <= ms_max && best_score > 0; ms++)
+	{
+		for(uint8_t pll_int = 0; pll_int < 2; pll_int++)
+		{
+			struct Si5351FreqPlan cand = *plan;
+			uint64_t target = freq_r * ms;
+			uint64_t vco_num = 0;
+			uint32_t vco_den = 1;
+
+			if(pll_int)
+			{
+				uint64_t a = (target + ref_freq / 2) / ref_freq;
+
+				vco_num = ref_freq * a;
+				if(vco_num < SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT || vco_num > SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT)
+				{
+					continue;
+				}
+				cand.pll_reg.p1 = (uint32_t)(128 * a - 512);
+				cand.pll_reg.p2 = 0;
+				cand.pll_reg.p3 = 1;
+			}
+			else
+			{
+				si5351_pll_calc_exact(ref_freq, target, &cand.pll_reg, &vco_num, &vco_den);
+			}
+
+			uint64_t target_scaled = target * vco_den;
+			uint64_t err = vco_num > target_scaled ? vco_num - target_scaled : target_scaled - vco_num;
+			uint64_t err_den = (uint64_t)vco_den * ms * (freq_r / plan->freq);
+			int64_t err_uhz = (int64_t)((err * 10000ULL + err_den / 2) / err_den);
+
+			if(err_uhz > max_error)
+			{
+				continue;
+			}
+
+			cand.pll_freq = vco_num / vco_den;
+			cand.actual_freq = (vco_num + err_den / 2) / err_den;
+			cand.error = vco_num >= target_scaled ? err_uhz : -err_uhz;
+			cand.ms_reg.p1 = cand.div_by_4 ? 0 : 128 * ms - 512;
+			cand.ms_reg.p2 = 0;
+			cand.ms_reg.p3 = 1;
+			si5351_plan_grade(&cand, ref_freq);
+
+			uint16_t score = si5351_jitter_score(cand);
+			uint64_t best_abs = best.error < 0 ? -best.error : best.error;
+			if(score < best_score || (score == best_score && (uint64_t)err_uhz < best_abs))
+			{
+				best = cand;
+				best_score = score;
+			}
+		}
+	}
+
+	*plan = best;
+	si5351_plan_pack(plan);
+
+	return 0;
+}
+
+/*
+ * si5351_make_plan(uint64_t freq, uint64_t ref_freq)
+ *
+ * si5351_plan_exact() by value, for initialising constexpr tables. A
+ * frequency that cannot be planned gives a plan with freq set to 0.
+ */
+constexpr struct Si5351FreqPlan si5351_make_plan(uint64_t freq, uint64_t ref_freq = SI5351_XTAL_FREQ * SI5351_FREQ_MULT)
+{
+	struct Si5351FreqPlan plan = {};
+
+	if(si5351_plan_exact(freq, ref_freq, &plan) != 0)
+	{
+		plan.freq = 0;
+	}
+
+	return plan;
+}
+
+/*
+ * si5351_make_plan_low_spur(uint64_t freq, uint64_t ref_freq, int64_t max_error)
+ *
+ * si5351_plan_low_spur() by value, with the same failure convention as
+ * si5351_make_plan().
+ */
+constexpr struct Si5351FreqPlan si5351_make_plan_low_spur(uint64_t freq, uint64_t ref_freq = SI5351_XTAL_FREQ * SI5351_FREQ_MULT, int64_t max_error = SI5351_LOW_SPUR_MAX_ERROR)
+{
+	struct Si5351FreqPlan plan = {};
+
+	if(si5351_plan_low_spur(freq, ref_freq, max_error, &plan) != 0)
+	{
+		plan.freq = 0;
+	}
+
+	return plan;
+}
+
+/*
+ * si5351_plan_check(const struct Si5351FreqPlan &plan, uint64_t ref_freq)
+ *
+ * Decode the packed register images of a plan the way the device would
+ * and confirm that they give the output frequency and error the solver
+ * reported (to within the two micro-hertz that rounding can add), with the VCO in range.
+ */
+constexpr bool si5351_plan_check(const struct Si5351FreqPlan &plan, uint64_t ref_freq)
+{
+	if(plan.freq == 0)
+	{
+		return false;
+	}
+
+	const uint8_t *pll = plan.pll_params;
+	const uint8_t *ms = plan.ms_params;
+
+	uint64_t pll_p1 = ((uint64_t)(pll[2] & 0x03) << 16) | ((uint64_t)pll[3] << 8) | pll[4];
+	uint64_t pll_p2 = ((uint64_t)(pll[5] & 0x0F) << 16) | ((uint64_t)pll[6] << 8) | pll[7];
+	uint64_t pll_p3 = ((uint64_t)(pll[5] & 0xF0) << 12) | ((uint64_t)pll[0] << 8) | pll[1];
+	uint64_t ms_p1 = ((uint64_t)(ms[2] & 0x03) << 16) | ((uint64_t)ms[3] << 8) | ms[4];
+	uint64_t ms_p2 = ((uint64_t)(ms[5] & 0x0F) << 16) | ((uint64_t)ms[6] << 8) | ms[7];
+	uint64_t ms_p3 = ((uint64_t)(ms[5] & 0xF0) << 12) | ((uint64_t)ms[0] << 8) | ms[1];
+	uint64_t r = 1ULL << ((ms[2] >> SI5351_OUTPUT_CLK_DIV_SHIFT) & 0x07);
+	uint64_t div_num = 0;
+	uint64_t div_den = 1;
+
+	if((ms[2] & SI5351_OUTPUT_CLK_DIVBY4) == SI5351_OUTPUT_CLK_DIVBY4)
+	{
+		div_num = 4;
+	}
+	else if(ms_p3 != 0)
+	{
+		// Multisynth a + b/c as div_num / div_den
+		div_num = ms_p3 * (ms_p1 + 512) + ms_p2;
+		div_den = 128 * ms_p3;
+	}
+	else
+	{
+		return false;
+	}
+
+	// VCO = ref * (P3 * (P1 + 512) + P2) / (128 * P3), split so that
+	// nothing overflows 64 bits
+	uint64_t num = pll_p3 * (pll_p1 + 512) + pll_p2;
+	uint64_t den = 128 * pll_p3;
+	uint64_t vco_whole = ref_freq * (num / den) + (ref_freq * (num % den)) / den;
+	uint64_t vco_rem = (ref_freq * (num % den)) % den;
+	uint64_t vco_uhz = vco_whole * 10000ULL + (vco_rem * 10000ULL + den / 2) / den;
+
+	if(vco_uhz < SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT * 10000ULL || vco_uhz > SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT * 10000ULL)
+	{
+		return false;
+	}
+
+	int64_t out_uhz = 0;
+	if(div_den == 1 || div_num % div_den == 0)
+	{
+		uint64_t div = div_num / div_den;
+		out_uhz = (int64_t)((vco_uhz + (div * r) / 2) / (div * r));
+	}
+	else
+	{
+		// vco_uhz * div_den overflows 64 bits; a double is good to a
+		// small fraction of a micro-hertz at 225 MHz
+		out_uhz = (int64_t)((double)vco_uhz * (double)div_den / ((double)div_num * (double)r) + 0.5);
+	}
+	int64_t error = out_uhz - (int64_t)(plan.freq * 10000ULL);
+	int64_t diff = error - plan.error;
+
+	return diff >= -2 && diff <= 2;
+}
+
+#endif /* SI5351_CALC_H_ */
@@ -0,0 +1,242 @@
+/*
+ * si5351_emu.cpp - Si5351 register file emulator
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "si5351_emu.h"
+
+Si5351Emulator::Si5351Emulator(uint32_t xo_freq, uint8_t dev_addr):
+	xtal_freq(xo_freq),
+	clkin_freq(0),
+	i2c_addr(dev_addr)
+{
+	power_on_reset();
+}
+
+/*
+ * power_on_reset(void)
+ *
+ * Return the register map to the datasheet defaults: all outputs
+ * powered down and disabled, device ready (SYS_INIT clear).
+ */
+void Si5351Emulator::power_on_reset(void)
+{
+	memset(regs, 0, sizeof(regs));
+	regs[SI5351_OUTPUT_ENABLE_CTRL] = 0xFF;
+	for(uint8_t i = 0; i < 8; i++)
+	{
+		regs[SI5351_CLK0_CTRL + i] = SI5351_CLK_POWERDOWN;
+	}
+	regs[SI5351_CRYSTAL_LOAD] = SI5351_CRYSTAL_LOAD_10PF | 0b00010010;
+
+	reset_counters();
+}
+
+void Si5351Emulator::reset_counters(void)
+{
+	write_transactions = 0;
+	read_transactions = 0;
+	bytes_written = 0;
+	pll_resets[0] = 0;
+	pll_resets[1] = 0;
+}
+
+void Si5351Emulator::begin(void)
+{
+}
+
+uint8_t Si5351Emulator::probe(uint8_t dev_addr)
+{
+	// Same code as Wire for an address NACK
+	return dev_addr == i2c_addr ? 0 : 2;
+}
+
+uint8_t Si5351Emulator::write(uint8_t dev_addr, uint8_t reg, uint8_t bytes, const uint8_t *data)
+{
+	if(dev_addr != i2c_addr)
+	{
+		return 2;
+	}
+
+	write_transactions++;
+	bytes_written += bytes;
+
+	for(uint8_t i = 0; i < bytes; i++)
+	{
+		uint8_t addr = reg + i;
+
+		switch(addr)
+		{
+			case SI5351_DEVICE_STATUS:
+				// Read only
+				break;
+			case SI5351_INTERRUPT_STATUS:
+				// Sticky bits are cleared by writing 0
+				regs[addr] &= data[i];
+				break;
+			case SI5351_PLL_RESET:
+				// Self-clearing strobe
+				if(data[i] & SI5351_PLL_RESET_A)
+				{
+					pll_resets[SI5351_PLLA]++;
+				}
+				if(data[i] & SI5351_PLL_RESET_B)
+				{
+					pll_resets[SI5351_PLLB]++;
+				}
+				break;
+			default:
+				regs[addr] = data[i];
+				break;
+		}
+	}
+
+	return 0;
+}
+
+uint8_t Si5351Emulator::read(uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data)
+{
+	if(dev_addr != i2c_addr)
+	{
+		return 0;
+	}
+
+	read_transactions++;
+
+	for(uint8_t i = 0; i < bytes; i++)
+	{
+		data[i] = regs[(uint8_t)(reg + i)];
+	}
+
+	return bytes;
+}
+
+/*
+ * pll_freq(enum si5351_pll pll)
+ *
+ * VCO frequency in Hz decoded from the PLL parameter registers and the
+ * PLL input source selection.
+ */
+double Si5351Emulator::pll_freq(enum si5351_pll pll)
+{
+	uint8_t base = (pll == SI5351_PLLA) ? SI5351_PLLA_PARAMETERS : SI5351_PLLB_PARAMETERS;
+	uint8_t src_bit = (pll == SI5351_PLLA) ? SI5351_PLLA_SOURCE : SI5351_PLLB_SOURCE;
+	double ref;
+
+	if(regs[SI5351_PLL_INPUT_SOURCE] & src_bit)
+	{
+		ref = (double)clkin_freq / (double)(1 << ((regs[SI5351_PLL_INPUT_SOURCE] & SI5351_CLKIN_DIV_MASK) >> 6));
+	}
+	else
+	{
+		ref = xtal_freq;
+	}
+
+	uint32_t p3 = ((uint32_t)(regs[base + 5] & 0xF0) << 12) | ((uint32_t)regs[base] << 8) | regs[base + 1];
+	uint32_t p1 = ((uint32_t)(regs[base + 2] & 0x03) << 16) | ((uint32_t)regs[base + 3] << 8) | regs[base + 4];
+	uint32_t p2 = ((uint32_t)(regs[base + 5] & 0x0F) << 16) | ((uint32_t)regs[base + 6] << 8) | regs[base + 7];
+
+	if(p3 == 0)
+	{
+		return 0.0;
+	}
+
+	return ref * ((double)p1 + 512.0 + (double)p2 / (double)p3) / 128.0;
+}
+
+/*
+ * clk_freq(enum si5351_clock clk)
+ *
+ * Frequency in Hz that would appear on a CLK pin, or 0 if the output is
+ * powered down or disabled.
+ */
+double Si5351Emulator::clk_freq(enum si5351_clock clk)
+{
+	uint8_t ctrl = regs[SI5351_CLK0_CTRL + (uint8_t)clk];
+	uint8_t r_div;
+	double freq;
+
+	if((ctrl & SI5351_CLK_POWERDOWN) || (regs[SI5351_OUTPUT_ENABLE_CTRL] & (1 << (uint8_t)clk)))
+	{
+		return 0.0;
+	}
+
+	switch(ctrl & SI5351_CLK_INPUT_MASK)
+	{
+		case SI5351_CLK_INPUT_XTAL:
+			freq = xtal_freq;
+			break;
+		case SI5351_CLK_INPUT_CLKIN:
+			freq = clkin_freq;
+			break;
+		case SI5351_CLK_INPUT_MULTISYNTH_0_4:
+			freq = ms_freq(clk < SI5351_CLK4 ? SI5351_CLK0 : SI5351_CLK4);
+			break;
+		default:
+			freq = ms_freq(clk);
+			break;
+	}
+
+	if(clk <= SI5351_CLK5)
+	{
+		r_div = (regs[SI5351_CLK0_PARAMETERS + 2 + (clk * 8)] & SI5351_OUTPUT_CLK_DIV_MASK) >> SI5351_OUTPUT_CLK_DIV_SHIFT;
+	}
+	else if(clk == SI5351_CLK6)
+	{
+		r_div = regs[SI5351_CLK6_7_OUTPUT_DIVIDER] & SI5351_OUTPUT_CLK6_DIV_MASK;
+	}
+	else
+	{
+		r_div = (regs[SI5351_CLK6_7_OUTPUT_DIVIDER] & SI5351_OUTPUT_CLK_DIV_MASK) >> SI5351_OUTPUT_CLK_DIV_SHIFT;
+	}
+
+	return freq / (double)(1 << r_div);
+}
+
+double Si5351Emulator::ms_freq(enum si5351_clock clk)
+{
+	uint8_t ctrl = regs[SI5351_CLK0_CTRL + (uint8_t)clk];
+	double vco = pll_freq((ctrl & SI5351_CLK_PLL_SELECT) ? SI5351_PLLB : SI5351_PLLA);
+	double div;
+
+	if(clk <= SI5351_CLK5)
+	{
+		uint8_t base = SI5351_CLK0_PARAMETERS + (clk * 8);
+
+		if((regs[base + 2] & SI5351_OUTPUT_CLK_DIVBY4) == SI5351_OUTPUT_CLK_DIVBY4)
+		{
+			div = 4.0;
+		}
+		else
+		{
+			uint32_t p3 = ((uint32_t)(regs[base + 5] & 0xF0) << 12) | ((uint32_t)regs[base] << 8) | regs[base + 1];
+			uint32_t p1 = ((uint32_t)(regs[base + 2] & 0x03) << 16) | ((uint32_t)regs[base + 3] << 8) | regs[base + 4];
+			uint32_t p2 = ((uint32_t)(regs[base + 5] & 0x0F) << 16) | ((uint32_t)regs[base + 6] << 8) | regs[base + 7];
+
+			if(p3 == 0)
+			{
+				return 0.0;
+			}
+
+			div = ((double)p1 + 512.0 + (double)p2 / (double)p3) / 128.0;
+		}
+	}
+	else
+	{
+		// MS6 and MS7 are integer only, P1 is the divide ratio
+		div = regs[clk == SI5351_CLK6 ? SI5351_CLK6_PARAMETERS : SI5351_CLK7_PARAMETERS];
+		if(div == 0.0)
+		{
+			return 0.0;
+		}
+	}
+
+	return vco / div;
+}
@@ -0,0 +1,50 @@
+/*
+ * si5351_emu.h - Si5351 register file emulator
+ *
+ * An Si5351Bus implementation with no hardware behind it, so the Si5351
+ * driver can run in a plain host build, e.g.
+ *
+ *   g++ -std=c++17 -I lib/Si5351Arduino-2.2.0/src \
+ *       lib/Si5351Arduino-2.2.0/src/si5351.cpp \
+ *       lib/Si5351Arduino-2.2.0/src/si5351_emu.cpp main.cpp
+ *
+ * The emulator keeps the 256-byte register map, counts bus traffic and
+ * decodes the PLL and multisynth registers back into the frequency that
+ * the real device would produce on each CLK output.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef SI5351_EMU_H_
+#define SI5351_EMU_H_
+
+#include "si5351.h"
+
+class Si5351Emulator : public Si5351Bus
+{
+public:
+	Si5351Emulator(uint32_t xo_freq = SI5351_XTAL_FREQ, uint8_t dev_addr = SI5351_BUS_BASE_ADDR);
+	void begin(void);
+	uint8_t probe(uint8_t dev_addr);
+	uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t bytes, const uint8_t *data);
+	uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t bytes, uint8_t *data);
+	void power_on_reset(void);
+	void reset_counters(void);
+	double pll_freq(enum si5351_pll);
+	double clk_freq(enum si5351_clock);
+	uint8_t regs[SI5351_REGISTER_COUNT];
+	uint32_t xtal_freq;
+	uint32_t clkin_freq;
+	uint32_t write_transactions;
+	uint32_t read_transactions;
+	uint32_t bytes_written;
+	uint32_t pll_resets[2];
+private:
+	double ms_freq(enum si5351_clock);
+	uint8_t i2c_addr;
+};
+
+#endif /* SI5351_EMU_H_ */
@@ -16,6 +16,10 @@
            // reported by Test_Touch_Controller when the screen is NOT touched. When touched the z value
            // must be higher than the threshold for a touch to be detected.
   uint8_t  getTouch(uint16_t *x, uint16_t *y, uint16_t threshold = 600);
+           // Same as getTouch() but in one SPI transaction of well under 1ms: a burst of
+           // conversions per axis, median filtered and smoothed over successive calls.
+           // Suited to polling at a fixed rate from the main loop.
+  uint8_t  getTouchFast(uint16_t *x, uint16_t *y, uint16_t threshold = 600);
 
            // Run screen calibration and test, report calibration values to the serial port
   void     calibrateTouch(uint16_t *data, uint32_t color_fg, uint32_t color_bg, uint8_t size);
@@ -40,3 +44,5 @@
 
   uint32_t _pressTime;        // Press and hold time-out
   uint16_t _pressX, _pressY;  // For future use (last sampled calibrated coordinates)
+  uint16_t _touchFiltX, _touchFiltY; // getTouchFast() smoothed raw position
+  bool     _touchFiltValid = false;
@@ -0,0 +1,123 @@
+#include <math.h>
+#include <stdlib.h>
+#include "autocal.h"
+
+AutoCalibrator::AutoCalibrator(Si5351 &synth, enum si5351_pll_input ref, uint64_t testFreq)
+    : si5351(synth), refOsc(ref), freq(testFreq)
+{
+}
+
+void AutoCalibrator::start(int32_t startPpb)
+{
+  stepCount = 0;
+  lastError = 0;
+  calState = AutoCalState::Coarse;
+  apply(startPpb);
+}
+
+void AutoCalibrator::abort()
+{
+  if (isRunning())
+    calState = AutoCalState::Idle;
+}
+
+AutoCalState AutoCalibrator::addGate(uint32_t counts, uint32_t gateUs)
+{
+  if (!isRunning() || gateUs == 0)
+    return calState;
+
+  // This gate may have started before the last correction took effect
+  if (settle > 0)
+  {
+    settle--;
+    return calState;
+  }
+
+  sumCounts += counts;
+  sumGateUs += gateUs;
+  gates++;
+  if (calState == AutoCalState::Fine && gates < AUTOCAL_FINE_GATES)
+    return calState;
+
+  // Offset of the output from the test frequency; the correction has to
+  // move by the same amount to cancel it
+  double measured = (double)sumCounts * 1e6 / (double)sumGateUs;
+  double nominal = (double)freq / SI5351_FREQ_MULT;
+  double errorPpb = (measured / nominal - 1.0) * 1e9;
+  int32_t resolution = (int32_t)ceil(1e9 / (nominal * (double)sumGateUs / 1e6));
+
+  if (fabs(errorPpb) > AUTOCAL_MAX_OFFSET_PPB)
+  {
+    calState = AutoCalState::Failed;
+    return calState;
+  }
+  lastError = (int32_t)lround(errorPpb);
+
+  if (calState == AutoCalState::Coarse)
+  {
+    if (abs(lastError) <= 2 * resolution || stepCount >= AUTOCAL_COARSE_ROUNDS)
+    {
+      // One gate's count dither, averaged over the fine gates
+      target = (int32_t)ceil(resolution / sqrt((double)AUTOCAL_FINE_GATES));
+      if (target < AUTOCAL_TARGET_PPB)
+        target = AUTOCAL_TARGET_PPB;
+      startFine(resolution);
+    }
+    else
+      apply(current + lastError);
+    return calState;
+  }
+
+  if (stepCount >= AUTOCAL_MAX_STEPS)
+  {
+    calState = AutoCalState::Failed;
+    return calState;
+  }
+
+  // Output high means the correction is still too small. Where the
+  // reading says the answer is lies outside the bracket, an earlier
+  // noisy step excluded it: widen that side instead of bisecting.
+  int32_t estimate = current + lastError;
+  if (estimate > hi + resolution)
+    hi = estimate + resolution;
+  else if (estimate < lo - resolution)
+    lo = estimate - resolution;
+  else if (lastError > 0)
+    lo = current;
+  else if (lastError < 0)
+    hi = current;
+  else
+  {
+    // Within a count of the answer, which is not the same as on it
+    if (lo < current - resolution)
+      lo = current - resolution;
+    if (hi > current + resolution)
+      hi = current + resolution;
+  }
+
+  apply(lo + (hi - lo) / 2);
+  if (hi - lo <= target)
+    calState = AutoCalState::Done;
+
+  return calState;
+}
+
+void AutoCalibrator::startFine(int32_t resolutionPpb)
+{
+  // The coarse estimate is within two counts, bracket it with a margin
+  lo = current - 2 * resolutionPpb - 1;
+  hi = current + 2 * resolutionPpb + 1;
+  calState = AutoCalState::Fine;
+  apply(lo + (hi - lo) / 2);
+}
+
+void AutoCalibrator::apply(int32_t ppb)
+{
+  current = ppb;
+  si5351.set_correction(ppb, refOsc);
+  stepCount++;
+  settle = AUTOCAL_SETTLE_GATES;
+  gates = 0;
+  sumCounts = 0;
+  sumGateUs = 0;
+}
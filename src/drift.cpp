@@ -0,0 +1,176 @@
+#include "drift.h"
+
+DriftCompensator::DriftCompensator(Si5351 &synth, enum si5351_pll_input ref)
+    : si5351(synth), refOsc(ref)
+{
+}
+
+// Static calibration value, already applied with set_correction()
+void DriftCompensator::setBaseCorrection(int32_t ppb)
+{
+  base = ppb;
+  applied = ppb;
+}
+
+// New static value for the same crystal, e.g. a measured correction that
+// was just applied. The calibration points keep the corrections they
+// measured rather than moving with the base, as they do for
+// setBaseCorrection().
+void DriftCompensator::rebaseCorrection(int32_t ppb)
+{
+  for (uint8_t i = 0; i < pointTotal; i++)
+    pointPpb[i] += base - ppb;
+  base = ppb;
+  applied = ppb;
+  fitModel();
+}
+
+void DriftCompensator::setTemperature(float tempC)
+{
+  temperature = tempC;
+}
+
+// Crystal offset measured at a known temperature, e.g. against a counter
+// or GPS reference. The oldest point is dropped once the table is full.
+bool DriftCompensator::addCalibrationPoint(float tempC, int32_t offsetPpb)
+{
+  pointTemp[pointNext] = tempC;
+  pointPpb[pointNext] = offsetPpb;
+  pointNext = (pointNext + 1) % DRIFT_MAX_POINTS;
+  if (pointTotal < DRIFT_MAX_POINTS)
+    pointTotal++;
+
+  // The new point replaces whatever the bias had learned
+  biasPpb = 0.0f;
+  return fitModel();
+}
+
+// Offset measured without a temperature; nudges the bias on top of the model
+void DriftCompensator::addReferenceMeasurement(int32_t offsetPpb)
+{
+  biasPpb += DRIFT_BIAS_WEIGHT * ((float)offsetPpb - (modelPpb() + biasPpb));
+}
+
+void DriftCompensator::clearModel()
+{
+  pointNext = 0;
+  pointTotal = 0;
+  biasPpb = 0.0f;
+  coeff[0] = coeff[1] = coeff[2] = 0.0f;
+}
+
+int32_t DriftCompensator::targetCorrection() const
+{
+  return base + (int32_t)lroundf(modelPpb() + biasPpb);
+}
+
+// Step the applied correction towards the target, at most
+// DRIFT_MAX_STEP_PPB every DRIFT_UPDATE_INTERVAL_MS
+bool DriftCompensator::update(uint32_t nowMs)
+{
+  if (updated && nowMs - lastUpdateMs < DRIFT_UPDATE_INTERVAL_MS)
+    return false;
+
+  int32_t diff = targetCorrection() - applied;
+  if (abs(diff) < DRIFT_DEADBAND_PPB)
+    return false;
+
+  int32_t step = constrain(diff, -DRIFT_MAX_STEP_PPB, DRIFT_MAX_STEP_PPB);
+  if (si5351.trim_correction(applied + step, refOsc) != 0)
+    return false;
+
+  applied += step;
+  lastUpdateMs = nowMs;
+  updated = true;
+  return true;
+}
+
+float DriftCompensator::modelPpb() const
+{
+  if (pointTotal == 0)
+    return 0.0f;
+  if (isnan(temperature))
+    return coeff[0];
+
+  float dT = temperature - refTemp;
+  return coeff[0] + coeff[1] * dT + coeff[2] * dT * dT;
+}
+
+// Least squares fit around the mean temperature. Drops to a line or a
+// constant when the points do not span enough temperature for more.
+bool DriftCompensator::fitModel()
+{
+  coeff[0] = coeff[1] = coeff[2] = 0.0f;
+  if (pointTotal == 0)
+    return false;
+
+  double mean = 0.0, tMin = pointTemp[0], tMax = pointTemp[0];
+  for (uint8_t i = 0; i < pointTotal; i++)
+  {
+    mean += pointTemp[i];
+    tMin = min(tMin, (double)pointTemp[i]);
+    tMax = max(tMax, (double)pointTemp[i]);
+  }
+  mean /= pointTotal;
+  refTemp = (float)mean;
+
+  int terms = 1;
+  if (tMax - tMin >= 1.0)
+    terms = pointTotal >= 3 ? 3 : 2;
+
+  for (; terms >= 1; terms--)
+  {
+    // Normal equations, augmented with the right hand side
+    double m[3][4] = {};
+    for (uint8_t i = 0; i < pointTotal; i++)
+    {
+      double dT = pointTemp[i] - mean;
+      double p[3] = {1.0, dT, dT * dT};
+      for (int r = 0; r < terms; r++)
+      {
+        for (int c = 0; c < terms; c++)
+          m[r][c] += p[r] * p[c];
+        m[r][terms] += p[r] * pointPpb[i];
+      }
+    }
+
+    bool singular = false;
+    for (int col = 0; col < terms && !singular; col++)
+    {
+      int pivot = col;
+      for (int r = col + 1; r < terms; r++)
+      {
+        if (fabs(m[r][col]) > fabs(m[pivot][col]))
+          pivot = r;
+      }
+      if (fabs(m[pivot][col]) < 1e-9)
+      {
+        singular = true;
+        break;
+      }
+      for (int c = 0; c <= terms; c++)
+      {
+        double t = m[col][c];
+        m[col][c] = m[pivot][c];
+        m[pivot][c] = t;
+      }
+      for (int r = 0; r < terms; r++)
+      {
+        if (r == col)
+          continue;
+        double f = m[r][col] / m[col][col];
+        for (int c = col; c <= terms; c++)
+          m[r][c] -= f * m[col][c];
+      }
+    }
+
+    if (!singular)
+    {
+      for (int r = 0; r < terms; r++)
+        coeff[r] = (float)(m[r][terms] / m[r][r]);
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,152 @@
+#include "freqcounter.h"
+#include <esp_timer.h>
+#include <soc/pcnt_struct.h>
+
+static portMUX_TYPE counterMux = portMUX_INITIALIZER_UNLOCKED;
+
+FrequencyCounter::FrequencyCounter(int inputPin, int ppsPin)
+    : inputPin(inputPin), ppsPin(ppsPin)
+{
+}
+
+bool FrequencyCounter::begin(uint32_t longGateMs)
+{
+  if (running)
+    return true;
+
+  pcnt_config_t cfg = {};
+  cfg.pulse_gpio_num = inputPin;
+  cfg.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  cfg.channel = PCNT_CHANNEL_0;
+  cfg.unit = FREQCOUNTER_UNIT;
+  cfg.pos_mode = PCNT_COUNT_INC;
+  cfg.neg_mode = PCNT_COUNT_DIS;
+  cfg.lctrl_mode = PCNT_MODE_KEEP;
+  cfg.hctrl_mode = PCNT_MODE_KEEP;
+  cfg.counter_h_lim = FREQCOUNTER_H_LIM;
+  cfg.counter_l_lim = 0;
+  if (pcnt_unit_config(&cfg) != ESP_OK)
+    return false;
+
+  // The glitch filter tops out far below the 14 MHz test signal
+  pcnt_filter_disable(FREQCOUNTER_UNIT);
+  pcnt_event_enable(FREQCOUNTER_UNIT, PCNT_EVT_H_LIM);
+  pcnt_counter_pause(FREQCOUNTER_UNIT);
+  pcnt_counter_clear(FREQCOUNTER_UNIT);
+
+  esp_err_t err = pcnt_isr_service_install(0);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // Already installed is fine
+    return false;
+  pcnt_isr_handler_add(FREQCOUNTER_UNIT, onOverflow, this);
+
+  overflows = 0;
+  ppsEdges = 0;
+  ppsEdgesSeen = 0;
+  longGateUs = longGateMs * 1000UL;
+  pcnt_counter_resume(FREQCOUNTER_UNIT);
+
+  if (usesPps())
+  {
+    pinMode(ppsPin, INPUT);
+    attachInterruptArg(ppsPin, onPps, this, RISING);
+  }
+  else
+  {
+    gateStartUs = esp_timer_get_time();
+    gateStartCount = total();
+  }
+
+  running = true;
+  return true;
+}
+
+void FrequencyCounter::end()
+{
+  if (!running)
+    return;
+
+  if (usesPps())
+    detachInterrupt(ppsPin);
+  pcnt_counter_pause(FREQCOUNTER_UNIT);
+  pcnt_event_disable(FREQCOUNTER_UNIT, PCNT_EVT_H_LIM);
+  pcnt_isr_handler_remove(FREQCOUNTER_UNIT);
+  running = false;
+}
+
+// Returns true and the counts of the last gate once a new gate has closed
+bool FrequencyCounter::poll(uint32_t *counts, uint32_t *gateUs)
+{
+  if (!running)
+    return false;
+
+  if (usesPps())
+  {
+    portENTER_CRITICAL(&counterMux);
+    uint32_t edges = ppsEdges;
+    uint32_t diff = ppsCount - ppsPrevCount;
+    int64_t interval = ppsUs - ppsPrevUs;
+    portEXIT_CRITICAL(&counterMux);
+
+    if (edges == ppsEdgesSeen)
+      return false;
+    bool missed = edges - ppsEdgesSeen > 1;
+    ppsEdgesSeen = edges;
+
+    // First edge only opens the gate; a lost or extra pulse spoils it
+    if (edges < 2 || missed || interval < 900000 || interval > 1100000)
+      return false;
+
+    *counts = diff;
+    *gateUs = 1000000;
+    return true;
+  }
+
+  int64_t now = esp_timer_get_time();
+  if (now - gateStartUs < longGateUs)
+    return false;
+
+  portENTER_CRITICAL(&counterMux);
+  now = esp_timer_get_time();
+  uint32_t count = total();
+  portEXIT_CRITICAL(&counterMux);
+
+  *counts = count - gateStartCount;
+  *gateUs = (uint32_t)(now - gateStartUs);
+  gateStartCount = count;
+  gateStartUs = now;
+  return true;
+}
+
+void IRAM_ATTR FrequencyCounter::onOverflow(void *arg)
+{
+  FrequencyCounter *self = static_cast<FrequencyCounter *>(arg);
+  self->overflows = self->overflows + 1;
+}
+
+void IRAM_ATTR FrequencyCounter::onPps(void *arg)
+{
+  FrequencyCounter *self = static_cast<FrequencyCounter *>(arg);
+  portENTER_CRITICAL_ISR(&counterMux);
+  uint32_t count = self->total();
+  self->ppsPrevCount = self->ppsCount;
+  self->ppsPrevUs = self->ppsUs;
+  self->ppsCount = count;
+  self->ppsUs = esp_timer_get_time();
+  self->ppsEdges = self->ppsEdges + 1;
+  portEXIT_CRITICAL_ISR(&counterMux);
+}
+
+// Running edge count. Must be called with interrupts held off. The unit
+// may have wrapped without the overflow handler having run yet, in which
+// case its event bit is still raised and the wrap is counted here.
+uint32_t IRAM_ATTR FrequencyCounter::total() const
+{
+  uint32_t wraps = overflows;
+  uint32_t value = PCNT.cnt_unit[FREQCOUNTER_UNIT].cnt_val;
+  if (PCNT.int_raw.val & BIT(FREQCOUNTER_UNIT))
+  {
+    value = PCNT.cnt_unit[FREQCOUNTER_UNIT].cnt_val;
+    wraps++;
+  }
+  return wraps * FREQCOUNTER_H_LIM + value;
+}
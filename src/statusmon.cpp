@@ -0,0 +1,132 @@
+#include "statusmon.h"
+
+static portMUX_TYPE statusMux = portMUX_INITIALIZER_UNLOCKED;
+
+StatusMonitor::StatusMonitor(Si5351AsyncBus &bus, uint8_t devAddr)
+    : bus(bus), devAddr(devAddr)
+{
+}
+
+bool StatusMonitor::begin(uint32_t periodMs)
+{
+  if (task != nullptr)
+    return true;
+
+  setPeriod(periodMs);
+  stopping = false;
+  return xTaskCreate(taskMain, "si5351mon", STATUSMON_STACK_SIZE, this, STATUSMON_PRIORITY, &task) == pdPASS;
+}
+
+// The task may be waiting on the bus, so it is asked to stop rather than
+// deleted; isRunning() drops once it has
+void StatusMonitor::end()
+{
+  stopping = true;
+}
+
+void StatusMonitor::setPeriod(uint32_t periodMs)
+{
+  this->periodMs = periodMs < 10 ? 10 : periodMs;
+}
+
+bool StatusMonitor::locked(enum si5351_pll pll) const
+{
+  return !(lastStatus & (pll == SI5351_PLLA ? STATUSMON_LOL_A : STATUSMON_LOL_B));
+}
+
+// Events raised since the last call
+uint8_t StatusMonitor::takeEvents()
+{
+  portENTER_CRITICAL(&statusMux);
+  uint8_t taken = events;
+  events = 0;
+  portEXIT_CRITICAL(&statusMux);
+  return taken;
+}
+
+StatusCounters StatusMonitor::counters() const
+{
+  portENTER_CRITICAL(&statusMux);
+  StatusCounters copy = counts;
+  portEXIT_CRITICAL(&statusMux);
+  return copy;
+}
+
+void StatusMonitor::resetCounters()
+{
+  portENTER_CRITICAL(&statusMux);
+  counts = {};
+  portEXIT_CRITICAL(&statusMux);
+}
+
+void StatusMonitor::taskMain(void *arg)
+{
+  StatusMonitor *self = static_cast<StatusMonitor *>(arg);
+  TickType_t wake = xTaskGetTickCount();
+  bool primed = false;
+
+  while (!self->stopping)
+  {
+    if (!primed)
+    {
+      // Flags left over from power-up are history, not events
+      uint8_t sticky = 0;
+      if (self->bus.read(self->devAddr, SI5351_INTERRUPT_STATUS, 1, &sticky) == 1)
+      {
+        uint8_t clear = (uint8_t)~(sticky & STATUSMON_EVENTS);
+        self->bus.write(self->devAddr, SI5351_INTERRUPT_STATUS, 1, &clear);
+        primed = true;
+      }
+    }
+    else
+      self->poll();
+
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(self->periodMs));
+  }
+
+  self->task = nullptr;
+  vTaskDelete(nullptr);
+}
+
+void StatusMonitor::poll()
+{
+  uint8_t regs[2];
+  bool ok = bus.read(devAddr, SI5351_DEVICE_STATUS, 2, regs) == 2;
+
+  portENTER_CRITICAL(&statusMux);
+  counts.polls++;
+  if (!ok)
+    counts.readErrors++;
+  portEXIT_CRITICAL(&statusMux);
+  if (!ok)
+    return;
+
+  uint8_t live = regs[0] & STATUSMON_EVENTS;
+  uint8_t sticky = regs[1] & STATUSMON_EVENTS;
+
+  // A flag still live from the last poll keeps re-arming its sticky bit
+  // and is the same event; otherwise live or sticky means a new one
+  uint8_t raised = (live | sticky) & ~lastStatus;
+  lastStatus = live;
+
+  if (sticky)
+  {
+    // Sticky bits clear on a written 0; the ones not seen get a 1 and
+    // are left alone in case they were raised since the read
+    uint8_t clear = (uint8_t)~sticky;
+    bus.write(devAddr, SI5351_INTERRUPT_STATUS, 1, &clear);
+  }
+
+  if (!raised)
+    return;
+
+  portENTER_CRITICAL(&statusMux);
+  events |= raised;
+  if (raised & STATUSMON_LOL_A)
+    counts.lolA++;
+  if (raised & STATUSMON_LOL_B)
+    counts.lolB++;
+  if (raised & STATUSMON_SYS_INIT)
+    counts.sysInit++;
+  portEXIT_CRITICAL(&statusMux);
+}
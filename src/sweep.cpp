@@ -0,0 +1,214 @@
+#include "sweep.h"
+
+SweepEngine *SweepEngine::instance = nullptr;
+
+SweepEngine::SweepEngine(Si5351 &synth, Si5351AsyncBus *bus, enum si5351_clock clk)
+    : si5351(synth), asyncBus(bus), clock(clk)
+{
+}
+
+SweepEngine::~SweepEngine()
+{
+  stop();
+  free(stepImage);
+}
+
+bool SweepEngine::configure(uint64_t start, uint64_t stop, uint32_t count, uint32_t dwell)
+{
+  if (active)
+    return false;
+  if (count < 2 || count > SWEEP_MAX_STEPS || dwell < SWEEP_MIN_DWELL_US || start == stop)
+    return false;
+
+  int64_t t0 = esp_timer_get_time();
+
+  // Lock the PLL for the highest step; every other step then needs a larger
+  // multisynth divider from the same VCO and never touches the PLL
+  struct Si5351FreqPlan plan;
+  uint64_t highest = start > stop ? start : stop;
+  if (si5351.calc_plan_exact(highest, si5351.pll_assignment[clock], &plan) != 0)
+    return false;
+  plan.int_mode = 0; // The steps are fractional dividers from this VCO
+  if (si5351.set_freq_plan(&plan, clock) != 0)
+    return false;
+  si5351.output_enable(clock, 0);
+
+  if (count != steps || stepImage == nullptr)
+  {
+    free(stepImage);
+    stepImage = (uint8_t(*)[SI5351_PARAMETERS_LENGTH])malloc((size_t)count * SI5351_PARAMETERS_LENGTH);
+    if (stepImage == nullptr)
+    {
+      steps = 0;
+      return false;
+    }
+  }
+
+  startFreq = start;
+  stopFreq = stop;
+  steps = count;
+  dwellUs = dwell;
+
+  for (uint16_t i = 0; i < steps; i++)
+  {
+    if (si5351.calc_ms_image(stepFreq(i), si5351.pll_assignment[clock], stepImage[i], NULL) != 0)
+    {
+      Serial.printf("Sweep step %u (%llu Hz) is out of range for one VCO\n", i, stepFreq(i) / SI5351_FREQ_MULT);
+      steps = 0;
+      return false;
+    }
+  }
+
+  planUs = (uint32_t)(esp_timer_get_time() - t0);
+  Serial.printf("Sweep %llu -> %llu Hz, %u steps, %lu us dwell, planned in %lu us\n",
+                startFreq / SI5351_FREQ_MULT, stopFreq / SI5351_FREQ_MULT, steps,
+                (unsigned long)dwellUs, (unsigned long)planUs);
+  return true;
+}
+
+uint64_t SweepEngine::stepFreq(uint16_t step) const
+{
+  if (steps < 2)
+    return startFreq;
+
+  // Linear in Hz * 100, rounded to the nearest centi-Hz
+  uint64_t span = startFreq > stopFreq ? startFreq - stopFreq : stopFreq - startFreq;
+  uint64_t delta = (span * step + (steps - 1) / 2) / (steps - 1);
+  return startFreq > stopFreq ? startFreq - delta : startFreq + delta;
+}
+
+bool SweepEngine::start(TaskHandle_t owner, bool repeatSweep)
+{
+  if (active || steps == 0 || owner == nullptr)
+    return false;
+
+  instance = this;
+  ownerTask = owner;
+  repeat = repeatSweep;
+
+  if (timer == nullptr)
+  {
+    timer = timerBegin(SWEEP_TIMER_NUM, 80, true); // 1 us ticks
+    timerAttachInterrupt(timer, &onStepTimer, true);
+  }
+
+  ticks = 0;
+  ticksServed = 0;
+  missed = 0;
+  failed = 0;
+  stepsDone = 0;
+
+  // Write the first step now, the timer paces the rest
+  if (!writeStep(0))
+    return false;
+  active = true;
+  si5351.output_enable(clock, 1);
+
+  timerWrite(timer, 0);
+  timerAlarmWrite(timer, dwellUs, true);
+  timerAlarmEnable(timer);
+
+  return true;
+}
+
+void SweepEngine::stop()
+{
+  if (timer != nullptr)
+    timerAlarmDisable(timer);
+
+  if (active)
+  {
+    active = false;
+    si5351.output_enable(clock, 0);
+    Serial.printf("Sweep stopped after %lu steps, %.1f steps/s (requested %.1f), %lu missed, %lu failed\n",
+                  (unsigned long)stepsDone, achievedStepRate(), 1e6f / dwellUs,
+                  (unsigned long)missed, (unsigned long)failed);
+  }
+}
+
+// Steps per second as the bus delivered them
+float SweepEngine::achievedStepRate() const
+{
+  if (stepsDone < 2 || lastDoneUs <= firstDoneUs)
+    return 0.0f;
+  return (stepsDone - 1) * 1e6f / (float)(lastDoneUs - firstDoneUs);
+}
+
+// Writes the step that is due. Called by the owner task each time it
+// wakes; returns true when a step went out.
+bool SweepEngine::service()
+{
+  if (!active)
+    return false;
+
+  uint32_t due = ticks;
+  if (due == ticksServed)
+    return false;
+  missed += due - ticksServed - 1;
+  ticksServed = due;
+
+  if (due >= steps && !repeat)
+  {
+    stop();
+    return false;
+  }
+  if (!writeStep(due % steps))
+  {
+    Serial.println("Sweep step could not be queued, stopping");
+    stop();
+    return false;
+  }
+  return true;
+}
+
+// The interrupt does no I2C, it only counts the edge and wakes the owner
+void IRAM_ATTR SweepEngine::onStepTimer()
+{
+  BaseType_t woken = pdFALSE;
+  if (instance != nullptr && instance->active)
+  {
+    instance->ticks = instance->ticks + 1;
+    vTaskNotifyGiveFromISR(instance->ownerTask, &woken);
+  }
+  portYIELD_FROM_ISR(woken);
+}
+
+// Runs once a step has reached the Si5351: on the I2C task behind an
+// async bus, straight after the write otherwise
+void SweepEngine::onStepWritten(uint8_t status, void *arg)
+{
+  SweepEngine *self = static_cast<SweepEngine *>(arg);
+  if (status != 0)
+  {
+    self->failed = self->failed + 1;
+    return;
+  }
+
+  int64_t now = esp_timer_get_time();
+  if (self->stepsDone == 0)
+    self->firstDoneUs = now;
+  self->lastDoneUs = now;
+  self->stepsDone = self->stepsDone + 1;
+}
+
+// False when the step could not be handed to the bus at all
+bool SweepEngine::writeStep(uint16_t index)
+{
+  step = index;
+
+  // One bulk write; the register shadow trims it to the bytes that differ
+  if (si5351.si5351_write_bulk(SI5351_CLK0_PARAMETERS + (clock * 8), SI5351_PARAMETERS_LENGTH, stepImage[index]) != 0)
+  {
+    failed = failed + 1;
+    return false;
+  }
+
+  if (asyncBus == nullptr)
+    onStepWritten(0, this);
+  else if (asyncBus->fence(onStepWritten, this) != 0)
+  {
+    failed = failed + 1;
+    return false;
+  }
+  return true;
+}
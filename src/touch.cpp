@@ -0,0 +1,156 @@
+#include "touch.h"
+
+TouchEngine::TouchEngine(TouchReader reader, int irqPin)
+    : reader(reader), irqPin(irqPin)
+{
+}
+
+void TouchEngine::begin()
+{
+  if (irqPin >= 0)
+  {
+    pinMode(irqPin, INPUT_PULLUP);
+    attachInterruptArg(irqPin, onPenIrq, this, FALLING);
+  }
+}
+
+// PENIRQ goes low when the pen touches; the next poll() samples
+void IRAM_ATTR TouchEngine::onPenIrq(void *arg)
+{
+  static_cast<TouchEngine *>(arg)->penIrq = true;
+}
+
+void TouchEngine::poll(uint32_t nowMs)
+{
+  if (nowMs - lastSampleMs < TOUCH_SAMPLE_MS)
+    return;
+  // With PENIRQ an idle panel is not read at all
+  if (irqPin >= 0 && state == State::Up && !penIrq)
+    return;
+
+  penIrq = false;
+  lastSampleMs = nowMs;
+  sample(nowMs);
+}
+
+// Oldest queued event, false when there is none
+bool TouchEngine::next(TouchEvent *ev)
+{
+  if (head == tail)
+    return false;
+  *ev = queue[tail];
+  tail = (tail + 1) % TOUCH_QUEUE_LEN;
+  return true;
+}
+
+// Drops queued events and ignores the touch in progress until it lifts,
+// so a press that changed the page does not act on the new one
+void TouchEngine::cancel()
+{
+  tail = head;
+  if (state == State::Pending)
+    state = State::Up;
+  else if (state == State::Down)
+    state = State::Ignore;
+}
+
+void TouchEngine::sample(uint32_t nowMs)
+{
+  int16_t sx, sy;
+  bool contact = reader(&sx, &sy);
+
+  if (!contact)
+  {
+    if (state == State::Pending)
+      state = State::Up;
+    if (state == State::Up || ++misses < TOUCH_RELEASE_SAMPLES)
+      return;
+
+    if (state == State::Down)
+    {
+      // A stroke long and quick enough is a swipe along its main axis
+      int16_t dx = x - startX;
+      int16_t dy = y - startY;
+      TouchDir dir = TouchDir::None;
+      if (lastSeenMs - downMs <= TOUCH_SWIPE_MAX_MS)
+      {
+        if (abs(dx) >= TOUCH_SWIPE_MIN && abs(dx) >= abs(dy))
+          dir = dx > 0 ? TouchDir::Right : TouchDir::Left;
+        else if (abs(dy) >= TOUCH_SWIPE_MIN)
+          dir = dy > 0 ? TouchDir::Down : TouchDir::Up;
+      }
+      if (dir != TouchDir::None)
+        emit(TouchEventType::Swipe, lastSeenMs, dir);
+      emit(TouchEventType::Release, lastSeenMs, TouchDir::None, !moved && !longSent);
+    }
+    state = State::Up;
+    return;
+  }
+
+  misses = 0;
+  x = sx;
+  y = sy;
+  lastSeenMs = nowMs;
+
+  switch (state)
+  {
+  case State::Up:
+    state = State::Pending;
+    hits = 0;
+    // fall through
+  case State::Pending:
+    if (++hits < TOUCH_PRESS_SAMPLES)
+      return;
+    state = State::Down;
+    startX = sx;
+    startY = sy;
+    downMs = nowMs;
+    nextRepeatMs = nowMs + TOUCH_REPEAT_DELAY_MS;
+    moved = false;
+    longSent = false;
+    emit(TouchEventType::Press, nowMs);
+    return;
+
+  case State::Ignore:
+    return;
+
+  case State::Down:
+    break;
+  }
+
+  // Once the finger wanders it is a drag, no longer a hold
+  if (!moved && (abs(x - startX) > TOUCH_SLOP || abs(y - startY) > TOUCH_SLOP))
+    moved = true;
+  if (moved)
+    return;
+
+  if (!longSent && nowMs - downMs >= TOUCH_LONG_MS)
+  {
+    longSent = true;
+    emit(TouchEventType::LongPress, nowMs);
+  }
+  if ((int32_t)(nowMs - nextRepeatMs) >= 0)
+  {
+    nextRepeatMs += TOUCH_REPEAT_MS;
+    emit(TouchEventType::Repeat, nowMs);
+  }
+}
+
+// Queues an event; when the page handlers fall behind the oldest goes
+void TouchEngine::emit(TouchEventType type, uint32_t nowMs, TouchDir dir, bool tap)
+{
+  uint8_t nextHead = (head + 1) % TOUCH_QUEUE_LEN;
+  if (nextHead == tail)
+    tail = (tail + 1) % TOUCH_QUEUE_LEN;
+
+  TouchEvent &ev = queue[head];
+  ev.type = type;
+  ev.x = x;
+  ev.y = y;
+  ev.startX = startX;
+  ev.startY = startY;
+  ev.heldMs = nowMs - downMs;
+  ev.dir = dir;
+  ev.tap = tap;
+  head = nextHead;
+}
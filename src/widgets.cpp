@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <string.h>
+#include "widgets.h"
+
+WidgetScreen::WidgetScreen(TFT_eSPI &tft) : tft(tft)
+{
+  memset(grid, 0, sizeof(grid));
+}
+
+// Starts a new page: drops the widgets and fills the screen on the next
+// render()
+void WidgetScreen::clear(uint16_t pageBg)
+{
+  this->pageBg = pageBg;
+  used = 0;
+  memset(grid, 0, sizeof(grid));
+  fillPending = true;
+  owned = true;
+}
+
+// Hands the screen to code that draws it directly (splash, QR code);
+// nothing is rendered until the next clear()
+void WidgetScreen::release()
+{
+  used = 0;
+  memset(grid, 0, sizeof(grid));
+  fillPending = false;
+  owned = false;
+}
+
+uint8_t WidgetScreen::add(WidgetKind kind, int16_t x, int16_t y, int16_t w, int16_t h, const GFXfont *font, uint16_t fg, uint16_t bg)
+{
+  if (used >= WIDGET_MAX)
+    return WIDGET_NONE;
+
+  Widget &wd = widgets[used];
+  memset(&wd, 0, sizeof(wd));
+  wd.kind = kind;
+  wd.x = x;
+  wd.y = y;
+  wd.w = w;
+  wd.h = h;
+  wd.font = font;
+  wd.fg = fg;
+  wd.bg = bg;
+  wd.frame = TFT_WHITE;
+  wd.tag = -1;
+  wd.dirty = true;
+  return used++;
+}
+
+uint8_t WidgetScreen::addButton(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t radius, const char *label,
+                                const GFXfont *font, uint16_t fg, uint16_t bg, uint8_t frames)
+{
+  uint8_t id = add(WidgetKind::Button, x, y, w, h, font, fg, bg);
+  if (id == WIDGET_NONE)
+    return id;
+  widgets[id].radius = radius;
+  widgets[id].frames = frames;
+  strncpy(widgets[id].text, label, WIDGET_TEXT_LEN - 1);
+  return id;
+}
+
+uint8_t WidgetScreen::addLabel(int16_t x, int16_t y, int16_t w, int16_t h, const char *text, const GFXfont *font, uint16_t fg)
+{
+  uint8_t id = add(WidgetKind::Label, x, y, w, h, font, fg, pageBg);
+  if (id != WIDGET_NONE)
+    strncpy(widgets[id].text, text, WIDGET_TEXT_LEN - 1);
+  return id;
+}
+
+uint8_t WidgetScreen::addReadout(int16_t x, int16_t y, int16_t w, int16_t h, const char *prefix, int64_t value,
+                                 const char *suffix, const GFXfont *font, uint16_t fg)
+{
+  uint8_t id = add(WidgetKind::Readout, x, y, w, h, font, fg, pageBg);
+  if (id == WIDGET_NONE)
+    return id;
+  widgets[id].prefix = prefix;
+  widgets[id].suffix = suffix;
+  widgets[id].value = value;
+  formatValue(widgets[id]);
+  return id;
+}
+
+void WidgetScreen::setText(uint8_t id, const char *text)
+{
+  if (id >= used || strncmp(widgets[id].text, text, WIDGET_TEXT_LEN - 1) == 0)
+    return;
+  strncpy(widgets[id].text, text, WIDGET_TEXT_LEN - 1);
+  widgets[id].dirty = true;
+}
+
+void WidgetScreen::setValue(uint8_t id, int64_t value)
+{
+  if (id >= used)
+    return;
+  Widget &wd = widgets[id];
+  wd.value = value;
+  char before[WIDGET_TEXT_LEN];
+  memcpy(before, wd.text, sizeof(before));
+  formatValue(wd);
+  if (memcmp(before, wd.text, sizeof(before)) != 0)
+    wd.dirty = true;
+}
+
+void WidgetScreen::setColors(uint8_t id, uint16_t fg, uint16_t bg)
+{
+  if (id >= used || (widgets[id].fg == fg && widgets[id].bg == bg))
+    return;
+  widgets[id].fg = fg;
+  widgets[id].bg = bg;
+  widgets[id].dirty = true;
+}
+
+void WidgetScreen::setFrame(uint8_t id, uint16_t frame, uint16_t bg, uint8_t radius, uint8_t frames)
+{
+  if (id >= used)
+    return;
+  Widget &wd = widgets[id];
+  if (wd.frame == frame && wd.bg == bg && wd.radius == radius && wd.frames == frames)
+    return;
+  wd.frame = frame;
+  wd.bg = bg;
+  wd.radius = radius;
+  wd.frames = frames;
+  wd.dirty = true;
+}
+
+void WidgetScreen::invalidate(uint8_t id)
+{
+  if (id < used)
+    widgets[id].dirty = true;
+}
+
+void WidgetScreen::invalidateAll()
+{
+  for (uint8_t i = 0; i < used; i++)
+    widgets[i].dirty = true;
+}
+
+// Makes a widget answer hitTest() with tag, entering it into every grid
+// cell its rectangle overlaps
+void WidgetScreen::setTouch(uint8_t id, int16_t tag)
+{
+  if (id >= used || widgets[id].tag >= 0 || tag < 0)
+    return;
+  const Widget &wd = widgets[id];
+  widgets[id].tag = tag;
+
+  int c0 = wd.x < 0 ? 0 : wd.x >> WIDGET_GRID_SHIFT;
+  int r0 = wd.y < 0 ? 0 : wd.y >> WIDGET_GRID_SHIFT;
+  int c1 = (wd.x + wd.w - 1) >> WIDGET_GRID_SHIFT;
+  int r1 = (wd.y + wd.h - 1) >> WIDGET_GRID_SHIFT;
+  if (c1 >= WIDGET_GRID_COLS)
+    c1 = WIDGET_GRID_COLS - 1;
+  if (r1 >= WIDGET_GRID_ROWS)
+    r1 = WIDGET_GRID_ROWS - 1;
+
+  for (int r = r0; r <= r1; r++)
+    for (int c = c0; c <= c1; c++)
+      grid[r][c] |= 1UL << id;
+}
+
+// Tag of the touchable widget under x, y or -1. Only the widgets sharing
+// the point's grid cell are checked against their exact rectangle; where
+// two overlap, the one added last (drawn on top) wins.
+int16_t WidgetScreen::hitTest(int16_t x, int16_t y) const
+{
+  if (x < 0 || y < 0 || (x >> WIDGET_GRID_SHIFT) >= WIDGET_GRID_COLS || (y >> WIDGET_GRID_SHIFT) >= WIDGET_GRID_ROWS)
+    return -1;
+
+  uint32_t cell = grid[y >> WIDGET_GRID_SHIFT][x >> WIDGET_GRID_SHIFT];
+  while (cell)
+  {
+    uint8_t id = 31 - __builtin_clz(cell);
+    const Widget &wd = widgets[id];
+    if (x >= wd.x && x < wd.x + wd.w && y >= wd.y && y < wd.y + wd.h)
+      return wd.tag;
+    cell &= ~(1UL << id);
+  }
+  return -1;
+}
+
+// Paints what changed since the last call. Returns true if anything was
+// drawn.
+bool WidgetScreen::render()
+{
+  if (!owned)
+    return false;
+
+  bool drawn = false;
+  if (fillPending)
+  {
+    tft.fillScreen(pageBg);
+    fillPending = false;
+    drawn = true;
+  }
+
+  for (uint8_t i = 0; i < used; i++)
+  {
+    if (!widgets[i].dirty)
+      continue;
+    draw(widgets[i]);
+    widgets[i].dirty = false;
+    drawn = true;
+  }
+  return drawn;
+}
+
+// prefix + value with ' between thousands + suffix
+void WidgetScreen::formatValue(Widget &wd)
+{
+  char digits[24];
+  char grouped[32];
+  uint64_t mag = wd.value < 0 ? 0 - (uint64_t)wd.value : (uint64_t)wd.value;
+  int n = snprintf(digits, sizeof(digits), "%llu", (unsigned long long)mag);
+
+  int g = 0;
+  if (wd.value < 0)
+    grouped[g++] = '-';
+  for (int i = 0; i < n; i++)
+  {
+    if (i > 0 && (n - i) % 3 == 0)
+      grouped[g++] = '\'';
+    grouped[g++] = digits[i];
+  }
+  grouped[g] = '\0';
+
+  snprintf(wd.text, WIDGET_TEXT_LEN, "%s%s%s", wd.prefix ? wd.prefix : "", grouped, wd.suffix ? wd.suffix : "");
+}
+
+void WidgetScreen::draw(const Widget &wd)
+{
+  if (wd.radius > 0)
+    tft.fillRoundRect(wd.x, wd.y, wd.w, wd.h, wd.radius, wd.bg);
+  else
+    tft.fillRect(wd.x, wd.y, wd.w, wd.h, wd.bg);
+
+  for (uint8_t i = 0; i < wd.frames; i++)
+    tft.drawRoundRect(wd.x + i, wd.y + i, wd.w - 2 * i, wd.h - 2 * i, wd.radius, wd.frame);
+
+  if (wd.text[0] == '\0')
+    return;
+
+  if (wd.font)
+    tft.setFreeFont(wd.font);
+  else
+    tft.setTextFont(2);
+  tft.setTextDatum(MC_DATUM);
+  tft.setTextColor(wd.fg, wd.bg);
+  tft.drawString(wd.text, wd.x + wd.w / 2, wd.y + wd.h / 2);
+}
@@ -1,5 +1,7 @@
 #include <Wire.h>
 #include <si5351.h>
+#include <si5351_calc.h>
+#include <si5351_async.h>
 #include <TFT_eSPI.h>
 #include <JetBrainsMono_Light13pt7b.h>
 #include <JetBrainsMono_Bold15pt7b.h>
@@ -9,58 +11,227 @@
 #include <PNGdec.h>
 #include "fancySplash.h" // Image is stored here in an 8-bit array  <https://notisrac.github.io/FileToCArray/ >(select treat as binary)
 #include "qrcode.h" 
+#include "drift.h"
+#include "autocal.h"
+#include "freqcounter.h"
+#include "statusmon.h"
+#include "widgets.h"
+#include "layout.h"
+#include "touch.h"
+#include "spsc.h"
+#include "sweep.h"
+#include "wspr.h"
 #define SI5351_SDA 25
 #define SI5351_SCL 26
 #define TFT_BLP 4
 
+// Display, touch and pages run on one core; everything that talks to the
+// Si5351 runs on the other, in rfTask alone, so drawing never delays a
+// retune or a WSPR symbol and no two tasks ever write the Si5351
+#define UI_CORE 1 // With the Arduino core
+#define RF_CORE 0
+#define UI_PRIORITY 1
+#define RF_PRIORITY 3 // Above the I2C task it feeds
+#define UI_STACK_SIZE 8192
+#define RF_STACK_SIZE 6144 // Low-spur planning and printf run here
+#define RF_SERVICE_MS 10 // Drift and calibration service rate when no command arrives
+#define RF_RESYNC_MS 1000 // At most one register resend per second while writes keep failing
+#define TEMP_SAMPLE_MS 1000 // Drift model temperature, sampled by the RF task
+#define TEMP_SMOOTHING 0.2f // Share of each sample taken into the filtered value
+#define ENTRY_SWEEP_STEPS 1000 // Holding OK on the entry page sweeps from CLK0 to the entry, repeating
+#define ENTRY_SWEEP_DWELL_US 10000
+#define WSPR_CALLSIGN "N0ABC" // Sent by holding a band button; set your own before flashing
+#define WSPR_LOCATOR "JN47"    // 4-character Maidenhead square
+#define WSPR_POWER_DBM 10
+
 // Instances
 TFT_eSPI tft = TFT_eSPI();
+WidgetScreen ui(tft); // Widgets of the page on screen, repainted only where they change
 PNG png;
-Si5351 si5351;
+Si5351WireBus si5351Wire(Wire);
+Si5351AsyncBus si5351Bus(si5351Wire, 2, RF_CORE); // I2C runs on its own task, next to the RF task
+Si5351 si5351(SI5351_BUS_BASE_ADDR, &si5351Bus);
 Preferences prefs;
+DriftCompensator driftComp(si5351);
+FrequencyCounter freqCounter; // CLK0 fed back to GPIO 34, GPS 1PPS on GPIO 35
+AutoCalibrator autoCal(si5351);
+SweepEngine sweep(si5351, &si5351Bus); // Steps CLK0; its timer wakes the RF task, which writes them
+WSPRTransmitter wspr(si5351);          // Keys CLK0 the same way, one symbol per timer edge
+StatusMonitor statusMon(si5351Bus); // Polls LOL_A/LOL_B/SYS_INIT on its own task
+bool readTouch(int16_t *x, int16_t *y);
+TouchEngine touch(readTouch); // Touch events for the page handlers, sampled by the UI task
 
 struct WSPRBand
 {
   uint64_t frequencyHz;
+  bool lowSpur; // Plan for jitter class and spur placement within SI5351_LOW_SPUR_MAX_ERROR
+};
+
+// The small multisynth ratios on the upper bands attenuate PLL spurs
+// the least, so those ask for low-spur plans
+constexpr WSPRBand bands[] = {
+    {1836600, false},
+    {3568600, false},
+    {7038600, false},
+    {10138700, false},
+    {14095600, false},
+    {18104600, false},
+    {21094600, false},
+    {24924600, true},
+    {28124600, true},
+
+    {50293000, true}};
+
+#define BAND_COUNT (sizeof(bands) / sizeof(bands[0]))
+static_assert(BAND_COUNT <= LAYOUT_BAND_SLOTS, "More bands than band buttons in layout.h");
+#define BAND_REF_FREQ (25000000ULL * SI5351_FREQ_MULT) // Crystal passed to si5351.init()
+
+// Band register images solved at compile time for an uncorrected crystal
+struct BandPlanTable
+{
+  Si5351FreqPlan plan[BAND_COUNT];
+};
+
+constexpr BandPlanTable makeBandPlans()
+{
+  BandPlanTable table = {};
+  for (size_t i = 0; i < BAND_COUNT; i++)
+  {
+    uint64_t freq = bands[i].frequencyHz * SI5351_FREQ_MULT;
+    table.plan[i] = bands[i].lowSpur ? si5351_make_plan_low_spur(freq, BAND_REF_FREQ) : si5351_make_plan(freq, BAND_REF_FREQ);
+  }
+  return table;
+}
+
+constexpr bool bandPlansValid(const BandPlanTable &table)
+{
+  for (size_t i = 0; i < BAND_COUNT; i++)
+  {
+    if (!si5351_plan_check(table.plan[i], BAND_REF_FREQ))
+      return false;
+  }
+  return true;
+}
+
+constexpr BandPlanTable bandPlans = makeBandPlans();
+static_assert(bandPlansValid(bandPlans), "Band register images do not decode to the band frequencies");
+
+// What the UI asks the RF task to do
+enum class RfCommandType : uint8_t
+{
+  TuneBand,        // arg: band index
+  TuneFrequency,   // freq: Hz * 100
+  CalibrationTone, // Stored correction, CLK0 on the calibration frequency
+  StepCorrection,  // arg: ppb to add
+  SaveCorrection,
+  StartAutoCal,
+  StopAutoCal,
+  StartSweep, // freq to stopFreq, arg: steps
+  StopSweep,
+  StartWspr,  // arg: band index
+  StopWspr
+};
+
+struct RfCommand
+{
+  RfCommandType type;
+  int32_t arg;
+  uint64_t freq;
+  uint64_t stopFreq; // StartSweep only, as are the two below
+  uint32_t dwellUs;
+  bool repeat;
 };
 
-WSPRBand bands[] = {
-    {1836600},
-    {3568600},
-    {7038600},
-    {10138700},
-    {14095600},
-    {18104600},
-    {21094600},
-    {24924600},
-    {28124600},
+// RF state as the UI shows it, sent whenever it changes
+struct RfStatus
+{
+  int32_t correctionPpb;
+  int32_t autoCalPpb;
+  bool autoCalRunning;
+  uint64_t clk0Freq; // Hz * 100 actually produced, 0 before the first tune or while sweeping
+  bool sweeping;
+  bool transmitting; // WSPR
+};
 
-    {50293000}};
+SpscQueue<RfCommand, 16> rfCommands; // UI task -> RF task
+SpscQueue<RfStatus, 8> rfStatusQueue; // RF task -> UI task
+TaskHandle_t uiTaskHandle = nullptr;
+TaskHandle_t rfTaskHandle = nullptr;
 
+// UI task only
 int selectedBand = -1;
 int currentPage = 0;
 int lastPage = -1;
+RfStatus rfView = {}; // Latest RfStatus received
+
+// RF task only, once the tasks are running
 int32_t correctionPpb = 0; // Global: current correction applied
+Si5351FreqPlan clk0Plan = {}; // Plan last sent to CLK0, shown and logged from here
+bool rfStatusPending = false; // A status that did not fit the queue yet
+// Enabled, 8 mA, not inverted, powered, own multisynth, low when disabled
+Si5351OutputState clk0Output = {1, SI5351_DRIVE_8MA, 0, 1, SI5351_CLK_SRC_MS, SI5351_CLK_DISABLE_LOW};
+
+// Widget ids on the page that is on screen (lastPage)
+uint8_t titleLabel = WIDGET_NONE;
+uint8_t toneLabel = WIDGET_NONE;
+uint8_t correctionReadout = WIDGET_NONE;
+uint8_t autoButton = WIDGET_NONE;
+uint8_t entryDisplay = WIDGET_NONE;
+uint8_t bandButtons[BAND_COUNT];
 
 // Function Prototypes
+void uiTask(void *arg);
+void rfTask(void *arg);
+bool sendRf(RfCommandType type, int32_t arg = 0, uint64_t freq = 0);
+bool sendRf(const RfCommand &cmd);
+void handleRfCommand(const RfCommand &cmd);
+void publishRfStatus();
+void serviceRfStatus();
 bool si5351CheckModule();
-void setCLK0freqMHz(float freqMHz);
-void drawFrequency(uint64_t freqHz, int x, int y, uint16_t textColor, uint16_t bgColor);
+bool setCLK0freq(uint64_t freq, bool lowSpur = false);
+void applyCLK0plan(const Si5351FreqPlan &plan);
+void resendCLK0();
+void setCLK0band(int band);
+String formatCentiHz(uint64_t freq);
 void drawBandButtons();
-void checkTouchBandSelectionPage();
+void showSelectedBand();
+void checkTouchBandSelectionPage(const TouchEvent &ev);
 void displaySplashScreen();
 void displayQRcodeScreen();
 void pngDraw(PNGDRAW *pDraw);
 void drawMainPage();
 void drawCalibrationPage();
-void checkTouchMainMenuPage();
-void checkTouchCalibrationPage();
+void checkTouchMainMenuPage(const TouchEvent &ev);
+void checkTouchCalibrationPage(const TouchEvent &ev);
+void drawCorrectionValue();
+void drawAutoButton();
+void startAutoCalibration();
+void stopAutoCalibration();
+void serviceAutoCalibration();
+void drawLockStatus();
+void serviceStatusMonitor();
+void serviceLockStatus();
+void recoverSi5351();
+void serviceWriteErrors();
+float crystalTemperature();
+void startSweep(const RfCommand &cmd);
+void stopSweep();
+void serviceSweep();
+void startWspr(int band);
+void stopWspr();
+void serviceWspr();
+void serviceSerial();
+void handleSerialCommand(char *line);
 void drawFrequencyEntryPage();
-String formatWithSwissSeparator(int32_t value);
-String frequencyInputStr = "";
-void checkTouchFrequencyEntryPage();
+String formatWithSwissSeparator(int64_t value);
+uint64_t frequencyInputHz = 0;
+uint32_t entryErrorMs = 0; // When "Out of range!" went up, 0 while not shown
+void showFrequencyInput();
+void serviceEntryError();
+void checkTouchFrequencyEntryPage(const TouchEvent &ev);
+void enterFrequency(bool sweepTo);
 void drawAboutPage();
-void checkTouchAboutPage();
+void checkTouchAboutPage(const TouchEvent &ev);
 
 
 void setup()
@@ -72,9 +243,11 @@ void setup()
   displaySplashScreen();
   pinMode(TFT_BLP, OUTPUT);
   digitalWrite(TFT_BLP, HIGH);
+  touch.begin();
   delay(1500);
 
   Wire.begin(SI5351_SDA, SI5351_SCL);
+  Wire.setClock(SWEEP_BUS_HZ); // The sweep's shortest dwell is worked out for this clock
 
   if (si5351CheckModule())
   {
@@ -84,6 +257,11 @@ void setup()
     prefs.end();
     Serial.printf("Loaded correction: %ld ppb\n", correctionPpb);
     si5351.set_correction(correctionPpb, SI5351_PLL_INPUT_XO);
+    driftComp.setBaseCorrection(correctionPpb);
+    statusMon.begin();
+    rfView.correctionPpb = correctionPpb;
+    if (!wspr.setMessage(WSPR_CALLSIGN, WSPR_LOCATOR, WSPR_POWER_DBM))
+      Serial.println("❌ WSPR_CALLSIGN, WSPR_LOCATOR or WSPR_POWER_DBM is not a valid WSPR message, WSPR disabled");
   }
   else
   {
@@ -97,51 +275,238 @@ void setup()
     while (1)
       ;
   }
+
+  xTaskCreatePinnedToCore(rfTask, "rf", RF_STACK_SIZE, nullptr, RF_PRIORITY, &rfTaskHandle, RF_CORE);
+  xTaskCreatePinnedToCore(uiTask, "ui", UI_STACK_SIZE, nullptr, UI_PRIORITY, &uiTaskHandle, UI_CORE);
 }
 
+// Everything runs on uiTask and rfTask
 void loop()
 {
-  if (currentPage != lastPage)
+  vTaskDelete(nullptr);
+}
+
+// Display, touch and page logic. Never touches the Si5351: retunes and
+// correction changes go to the RF task as commands, and what the pages
+// show of the RF side comes back as RfStatus.
+void uiTask(void *arg)
+{
+  for (;;)
   {
-    lastPage = currentPage;
-    switch (currentPage)
+    serviceRfStatus();
+    serviceLockStatus();
+    serviceSerial();
+    serviceEntryError();
+
+    if (currentPage != lastPage)
     {
-    case 0:
-      drawMainPage();
-      break;
-    case 1:
-      drawBandButtons();
-      break;
-    case 2:
-      drawCalibrationPage();
-      break;
-    case 3:
-      drawFrequencyEntryPage();
-      break;
-    case 4:
-      drawAboutPage();
-      break;
+      lastPage = currentPage;
+      touch.cancel(); // The touch that changed the page is not for this one
+      switch (currentPage)
+      {
+      case 0:
+        drawMainPage();
+        break;
+      case 1:
+        drawBandButtons();
+        break;
+      case 2:
+        drawCalibrationPage();
+        break;
+      case 3:
+        drawFrequencyEntryPage();
+        break;
+      case 4:
+        drawAboutPage();
+        break;
+      }
     }
+    ui.render();
+
+    // Touch events for the active page. A handler that changes the page
+    // ends the batch; the rest belongs to the old page.
+    touch.poll(millis());
+    TouchEvent ev;
+    int page = currentPage;
+    while (currentPage == page && touch.next(&ev))
+    {
+      switch (currentPage)
+      {
+      case 0:
+        checkTouchMainMenuPage(ev);
+        break;
+      case 1:
+        checkTouchBandSelectionPage(ev);
+        break;
+      case 2:
+        checkTouchCalibrationPage(ev);
+        break;
+      case 3:
+        checkTouchFrequencyEntryPage(ev);
+        break;
+      case 4:
+        checkTouchAboutPage(ev);
+        break;
+      }
+    }
+
+    vTaskDelay(1);
   }
+}
 
-  // Touch handling for active page
-  switch (currentPage)
+// Owns the Si5351, the correction and the calibration; the only task
+// that calls the driver. Wakes on each command, on each WSPR symbol and
+// sweep step edge (their timer interrupts notify it) and otherwise every
+// RF_SERVICE_MS to follow drift, feed the calibrator and handle status
+// monitor events. Slow work here, such as an NVS write, delays a due
+// edge; the next pass writes what is due by then and counts the rest.
+void rfTask(void *arg)
+{
+  for (;;)
   {
-  case 0:
-    checkTouchMainMenuPage();
-    break;
-  case 1:
-    checkTouchBandSelectionPage();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RF_SERVICE_MS));
+
+    // A due symbol or sweep step goes out before anything else
+    serviceWspr();
+    serviceSweep();
+
+    RfCommand cmd;
+    while (rfCommands.pop(cmd))
+      handleRfCommand(cmd);
+
+    // Follow crystal drift along the model each auto calibration adds a
+    // point to, a no-op until the first one has finished
+    driftComp.setTemperature(crystalTemperature());
+    if (!autoCal.isRunning())
+      driftComp.update(millis());
+    serviceAutoCalibration();
+    serviceStatusMonitor();
+    serviceWriteErrors();
+
+    if (rfStatusPending)
+      publishRfStatus();
+  }
+}
+
+// Queues a command for the RF task and wakes it. Called from the UI task only.
+bool sendRf(RfCommandType type, int32_t arg, uint64_t freq)
+{
+  RfCommand cmd = {};
+  cmd.type = type;
+  cmd.arg = arg;
+  cmd.freq = freq;
+  return sendRf(cmd);
+}
+
+bool sendRf(const RfCommand &cmd)
+{
+  if (!rfCommands.push(cmd))
+  {
+    Serial.println("RF command queue full, command dropped");
+    return false;
+  }
+  xTaskNotifyGive(rfTaskHandle);
+  return true;
+}
+
+void handleRfCommand(const RfCommand &cmd)
+{
+  switch (cmd.type)
+  {
+  case RfCommandType::TuneBand:
+    stopSweep();
+    stopWspr();
+    setCLK0band(cmd.arg);
     break;
-  case 2:
-    checkTouchCalibrationPage();
+
+  case RfCommandType::TuneFrequency:
+    stopSweep();
+    stopWspr();
+    setCLK0freq(cmd.freq);
     break;
-  case 3:
-    checkTouchFrequencyEntryPage();
+
+  case RfCommandType::CalibrationTone:
+    stopSweep();
+    stopWspr();
+    // Back to the stored correction first so 14 MHz is planned only once
+    si5351.set_correction(correctionPpb, SI5351_PLL_INPUT_XO);
+    driftComp.setBaseCorrection(correctionPpb);
+    setCLK0freq(AUTOCAL_TEST_FREQ);
     break;
-  case 4:
-    checkTouchAboutPage();
+
+  case RfCommandType::StepCorrection:
+    if (autoCal.isRunning())
+      return;
+    correctionPpb += cmd.arg;
+    // set_correction() retunes the running PLL, CLK0 stays where it is
+    si5351.set_correction(correctionPpb, SI5351_PLL_INPUT_XO);
+    driftComp.setBaseCorrection(correctionPpb);
     break;
+
+  case RfCommandType::SaveCorrection:
+    prefs.begin("si5351", false);
+    prefs.putInt("corr", correctionPpb);
+    prefs.end();
+    Serial.printf("Applied correction: %ld ppb (saved)\n", correctionPpb);
+    return;
+
+  case RfCommandType::StartAutoCal:
+    startAutoCalibration(); // Publishes its own status
+    return;
+
+  case RfCommandType::StopAutoCal:
+    stopAutoCalibration();
+    return;
+
+  case RfCommandType::StartSweep:
+    startSweep(cmd); // Publishes its own status
+    return;
+
+  case RfCommandType::StopSweep:
+    stopSweep();
+    return;
+
+  case RfCommandType::StartWspr:
+    startWspr(cmd.arg); // Publishes its own status
+    return;
+
+  case RfCommandType::StopWspr:
+    stopWspr();
+    return;
+  }
+  publishRfStatus();
+}
+
+// Sends the RF state to the UI task. When the queue is full the rfTask
+// loop tries again, so the UI always ends up with the latest state.
+void publishRfStatus()
+{
+  RfStatus st = {correctionPpb, autoCal.correction(), autoCal.isRunning(), clk0Plan.actual_freq, sweep.isActive(), wspr.isActive()};
+  rfStatusPending = !rfStatusQueue.push(st);
+}
+
+// Takes the RF task's status updates into rfView and refreshes what shows them
+void serviceRfStatus()
+{
+  RfStatus st;
+  bool changed = false;
+  while (rfStatusQueue.pop(st))
+  {
+    rfView = st;
+    changed = true;
+  }
+  if (!changed)
+    return;
+
+  drawCorrectionValue();
+  drawAutoButton();
+  if (lastPage == 1)
+    showSelectedBand();
+  if (lastPage == 2 && rfView.clk0Freq != 0)
+  {
+    char header[WIDGET_TEXT_LEN];
+    snprintf(header, sizeof(header), "CLK0 %s Hz", formatCentiHz(rfView.clk0Freq).c_str());
+    ui.setText(toneLabel, header);
   }
 }
 
@@ -206,344 +571,638 @@ void pngDraw(PNGDRAW *pDraw)
   tft.pushImage(0, 0 + pDraw->y, pDraw->iWidth, 1, lineBuffer);
 }
 
+// Touch point in screen coordinates; the panel's Y runs bottom to top.
+// One short SPI transaction, so the touch engine can sample it every
+// 10 ms without holding up the display.
+bool readTouch(int16_t *x, int16_t *y)
+{
+  uint16_t tx, ty;
+  if (!tft.getTouchFast(&tx, &ty))
+    return false;
+  *x = tx;
+  *y = tft.height() - ty;
+  return true;
+}
+
 bool si5351CheckModule()
 {
   return si5351.init(SI5351_CRYSTAL_LOAD_8PF, 25000000, 0);
 }
 
-void setCLK0freqMHz(float freqMHz)
+// Runs on the I2C task once a retune has reached the Si5351. A failed
+// write wakes the RF task, which puts the registers right
+void onSi5351Written(uint8_t status, void *arg)
 {
-  uint64_t freq_hundredths_Hz = (uint64_t)(freqMHz * 1e8);
-  si5351.set_freq(freq_hundredths_Hz, SI5351_CLK0);
-  si5351.drive_strength(SI5351_CLK0, SI5351_DRIVE_8MA);
-  si5351.output_enable(SI5351_CLK0, 1);
-  si5351.update_status();
-
-  Serial.print("CLK0 set to ");
-  Serial.print(freqMHz, 6);
-  Serial.println(" MHz");
+  if (status != 0)
+    xTaskNotifyGive(rfTaskHandle);
 }
 
-void drawFrequency(uint64_t freqHz, int x, int y, uint16_t textColor, uint16_t bgColor)
+// Every CLK0 retune goes through here with the frequency in Hz * 100,
+// the same unit the band table and the driver use. The plan is solved
+// once; the registers, the display and the log all read from clk0Plan.
+bool setCLK0freq(uint64_t freq, bool lowSpur)
 {
-  uint32_t MHz = freqHz / 1000000;
-  uint32_t frac = freqHz % 1000000;
-
-  char buf[20];
-  sprintf(buf, "%lu.%06lu", MHz, frac);
+  Si5351FreqPlan plan;
+  enum si5351_pll pll = si5351.pll_assignment[SI5351_CLK0];
+  uint8_t ret = lowSpur ? si5351.calc_plan_low_spur(freq, pll, SI5351_LOW_SPUR_MAX_ERROR, &plan)
+                        : si5351.calc_plan_cached(freq, pll, &plan);
+  if (ret != 0)
+  {
+    Serial.printf("❌ No plan for %s Hz\n", formatCentiHz(freq).c_str());
+    return false;
+  }
 
-  tft.setTextColor(textColor, bgColor);
-  tft.drawString(buf, x, y);
+  applyCLK0plan(plan);
+  return true;
 }
 
-void drawBandButtons()
+void applyCLK0plan(const Si5351FreqPlan &plan)
 {
-  const int btnWidth = 132, btnHeight = 34, spacingY = 11;
-  const int col1X = 15, col2X = 165;
-
-  tft.fillRect(0, 0, tft.width(), tft.height(), TFT_BLACK);
+  // Registers and output state go out together, each register at most once
+  clk0Plan = plan;
+  si5351.begin_transaction();
+  si5351.set_freq_plan(&clk0Plan, SI5351_CLK0);
+  si5351.set_output_state(SI5351_CLK0, &clk0Output);
+  si5351.commit();
+  si5351Bus.fence(onSi5351Written, nullptr);
+
+  Serial.printf("CLK0 set to %s Hz (error %lld uHz, jitter class %d, score %u)\n",
+                formatCentiHz(clk0Plan.actual_freq).c_str(), clk0Plan.error,
+                (int)clk0Plan.jitter_class, si5351_jitter_score(clk0Plan));
+}
 
-  for (int i = 0; i < 10; i++)
-  {
-    int row = i % 5;
-    int col = i / 5;
-    int x = (col == 0) ? col1X : col2X;
-    int y = row * (btnHeight + spacingY) + 2;
-    bool isSelected = (i == selectedBand);
+// Sends clk0Plan again at the driver's current correction. The plan's PLL
+// was solved for the correction in effect when it was made, and writing it
+// marks that PLL fresh, so the trim is staged in the same transaction:
+// only the re-solved PLL goes out
+void resendCLK0()
+{
+  if (clk0Plan.freq == 0)
+    return;
+  si5351.begin_transaction();
+  si5351.set_freq_plan(&clk0Plan, SI5351_CLK0);
+  si5351.set_output_state(SI5351_CLK0, &clk0Output);
+  si5351.trim_correction(si5351.get_correction(SI5351_PLL_INPUT_XO), SI5351_PLL_INPUT_XO);
+  si5351.commit();
+  si5351Bus.fence(onSi5351Written, nullptr);
+}
 
-    // Button background
-    uint16_t bgColor = isSelected ? TFT_GREEN : TFT_DARKGREY;
-    uint16_t textColor = isSelected ? TFT_BLACK : TFT_WHITE;
+void setCLK0band(int band)
+{
+  // Uncorrected crystal: blit the images baked into flash. Otherwise the
+  // registers are solved once per band and cached in the driver, except
+  // low-spur bands which are solved on every selection. The driver's
+  // correction is the one in effect, whoever set it (stored, drift or a
+  // calibration trial)
+  if (si5351.get_correction(SI5351_PLL_INPUT_XO) == 0)
+    applyCLK0plan(bandPlans.plan[band]);
+  else
+    setCLK0freq(bands[band].frequencyHz * SI5351_FREQ_MULT, bands[band].lowSpur);
+}
 
-    // Fill background
-    tft.fillRoundRect(x, y, btnWidth, btnHeight, 5, bgColor);
+// Hz * 100 as "14'095'600.00"
+String formatCentiHz(uint64_t freq)
+{
+  char frac[4];
+  snprintf(frac, sizeof(frac), ".%02u", (unsigned)(freq % SI5351_FREQ_MULT));
+  return formatWithSwissSeparator(freq / SI5351_FREQ_MULT) + frac;
+}
 
-    // 1-pixel white frame
-    tft.drawRoundRect(x, y, btnWidth, btnHeight, 5, TFT_WHITE);
+void drawBandButtons()
+{
+  ui.clear(TFT_BLACK);
 
-    // Frequency text
-    tft.setTextColor(textColor, bgColor);
-    tft.setFreeFont(&JetBrainsMono_Bold11pt7b);
-    tft.setTextDatum(MC_DATUM);
-    drawFrequency(bands[i].frequencyHz, x + btnWidth / 2, y + btnHeight / 2, textColor, bgColor);
+  for (size_t i = 0; i < BAND_COUNT; i++)
+  {
+    const LayoutItem &slot = bandLayout[i];
+    char mhz[20];
+    snprintf(mhz, sizeof(mhz), "%lu.%06lu", (unsigned long)(bands[i].frequencyHz / 1000000), (unsigned long)(bands[i].frequencyHz % 1000000));
+    bandButtons[i] = ui.addButton(slot.x, slot.y, slot.w, slot.h, 5, mhz, &JetBrainsMono_Bold11pt7b, TFT_WHITE, TFT_DARKGREY);
+    ui.setTouch(bandButtons[i], i);
   }
+  showSelectedBand();
 
   // Bottom info text
-  tft.setTextFont(2);
-  tft.setTextSize(1);
-  tft.setTextColor(TFT_WHITE, TFT_BLACK);
-  tft.drawCentreString("Long Press to Exit", 160, 225, 1);
+  ui.addLabel(0, 225, tft.width(), 16, "Hold a band: WSPR  Hold/Swipe: Exit", nullptr, TFT_WHITE);
 }
-void checkTouchBandSelectionPage()
+
+// Green for the selected band, red while it sends WSPR; only the buttons
+// that change get repainted
+void showSelectedBand()
 {
-  uint16_t x, y_raw;
-  if (tft.getTouch(&x, &y_raw))
+  for (size_t i = 0; i < BAND_COUNT; i++)
   {
-    int y = tft.height() - y_raw;
-
-    const int btnWidth = 132;
-    const int btnHeight = 34;
-    const int spacingY = 11;
-    const int col1X = 15;
-    const int col2X = 165;
-    const unsigned long longPressThreshold = 1000; // milliseconds
+    bool isSelected = ((int)i == selectedBand);
+    uint16_t fill = !isSelected ? TFT_DARKGREY : rfView.transmitting ? TFT_RED : TFT_GREEN;
+    ui.setColors(bandButtons[i], isSelected ? TFT_BLACK : TFT_WHITE, fill);
+  }
+}
 
-    for (int i = 0; i < 10; i++)
-    {
-      int row = i % 5;
-      int col = i / 5;
-      int bx = (col == 0) ? col1X : col2X;
-      int by = row * (btnHeight + spacingY) + 2;
+// A tap tunes the band and holding a band sends a WSPR message on it.
+// Holding anywhere else or swiping goes back.
+void checkTouchBandSelectionPage(const TouchEvent &ev)
+{
+  int16_t hit = ui.hitTest(ev.startX, ev.startY);
+  if (ev.type == TouchEventType::LongPress && hit >= 0)
+  {
+    selectedBand = bandLayout[hit].arg;
+    showSelectedBand();
+    sendRf(RfCommandType::StartWspr, selectedBand);
+    return;
+  }
+  if (ev.type == TouchEventType::LongPress || ev.type == TouchEventType::Swipe)
+  {
+    Serial.printf("📴 %s — returning to main page\n", ev.type == TouchEventType::Swipe ? "Swipe" : "Long press");
+    currentPage = 0;
+    return;
+  }
+  if (ev.type != TouchEventType::Release || !ev.tap)
+    return;
 
-      if (x >= bx && x <= bx + btnWidth && y >= by && y <= by + btnHeight)
-      {
-        // Start timing the press
-        unsigned long startTime = millis();
-
-        // Wait while still pressing
-        while (tft.getTouch(&x, &y_raw))
-        {
-          delay(10);
-        }
-
-        unsigned long pressDuration = millis() - startTime;
-
-        if (pressDuration >= longPressThreshold)
-        {
-          Serial.println("📴 Long press detected — returning to main page");
-          currentPage = 0;
-        }
-        else
-        {
-          if (i != selectedBand)
-          {
-            selectedBand = i;
-            drawBandButtons();
-            setCLK0freqMHz(bands[i].frequencyHz / 1000000.0f);
-          }
-        }
-        break;
-      }
-    }
+  // The selected band again after a message or a sweep brings its carrier back
+  if (hit >= 0 && (bandLayout[hit].arg != selectedBand || rfView.clk0Freq == 0))
+  {
+    selectedBand = bandLayout[hit].arg;
+    showSelectedBand();
+    sendRf(RfCommandType::TuneBand, selectedBand);
   }
 }
 
 void drawMainPage()
 {
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextColor(TFT_GREEN, TFT_BLACK);
-  tft.setFreeFont(&JetBrainsMono_Light13pt7b);
-  tft.setTextDatum(MC_DATUM);
-  tft.drawCentreString("✅ Si5351 Found & Ready", tft.width() / 2, 2, 1);
-  tft.setFreeFont(&UbuntuMono_Regular8pt7b);
-
-  tft.setTextColor(TFT_GOLD, TFT_BLACK);
+  ui.clear(TFT_BLACK);
+  titleLabel = ui.addLabel(0, 0, tft.width(), 30, "", &JetBrainsMono_Light13pt7b, TFT_GREEN);
+  drawLockStatus();
 
-  String corrStr = formatWithSwissSeparator(correctionPpb);
-  String line = "calfactor applied: " + corrStr + " ppb";
-  tft.drawCentreString(line, tft.width() / 2, 33, 1);
-  // Button layout
-  const int btnWidth = 200;
-  const int btnHeight = 40;
-  const int spacingY = 11;
-  const int startY = 58;
-  const int cornerRadius = 6;
+  ui.addReadout(0, 32, tft.width(), 18, "calfactor applied: ", rfView.correctionPpb, " ppb", &UbuntuMono_Regular8pt7b, TFT_GOLD);
 
-  struct
+  for (size_t i = 0; i < LAYOUT_COUNT(mainLayout); i++)
   {
-    const char *label;
-    int id;
-  } buttons[] = {
-      {"WSPR Freqs", 1},
-      {"Calibration", 2},
-      {"Manual Entry", 3}};
+    const LayoutItem &item = mainLayout[i];
+    uint8_t id;
+    if (item.arg == 4) // About... is a plain line of text
+      id = ui.addLabel(item.x, item.y, item.w, item.h, item.label, &UbuntuMono_Regular8pt7b, TFT_WHITE);
+    else
+      id = ui.addButton(item.x, item.y, item.w, item.h, 6, item.label, &JetBrainsMono_Bold11pt7b, TFT_WHITE, TFT_NAVY);
+    ui.setTouch(id, i);
+  }
+}
 
-  tft.setTextDatum(MC_DATUM); // Centered text
+// Main page title doubles as the lock health line: green while both PLLs
+// hold lock, red while one is out, orange once losses have been counted
+void drawLockStatus()
+{
+  StatusCounters c = statusMon.counters();
+  uint32_t losses = c.lolA + c.lolB + c.sysInit;
+  bool lockA = statusMon.locked(SI5351_PLLA);
+  bool lockB = statusMon.locked(SI5351_PLLB);
+
+  if (lastPage != 0)
+    return;
 
-  for (int i = 0; i < 3; i++)
+  char title[32];
+  uint16_t color = TFT_GREEN;
+  if (!lockA || !lockB)
   {
-    int x = (tft.width() - btnWidth) / 2;
-    int y = startY + i * (btnHeight + spacingY);
+    snprintf(title, sizeof(title), "PLL %s unlocked!", !lockA && !lockB ? "A+B" : (lockA ? "B" : "A"));
+    color = TFT_RED;
+  }
+  else if (losses > 0)
+  {
+    snprintf(title, sizeof(title), "Ready, %lu lock loss%s", (unsigned long)losses, losses == 1 ? "" : "es");
+    color = TFT_ORANGE;
+  }
+  else
+    strcpy(title, "✅ Si5351 Found & Ready");
 
-    // Button body
-    tft.fillRoundRect(x, y, btnWidth, btnHeight, cornerRadius, TFT_NAVY);
+  ui.setText(titleLabel, title);
+  ui.setColors(titleLabel, color, TFT_BLACK);
+}
 
-    // 1-pixel rounded border
-    tft.drawRoundRect(x, y, btnWidth, btnHeight, cornerRadius, TFT_WHITE);
+void checkTouchMainMenuPage(const TouchEvent &ev)
+{
+  if (ev.type != TouchEventType::Press)
+    return;
 
-    // Button label
-    tft.setFreeFont(&JetBrainsMono_Bold11pt7b);
-    tft.setTextColor(TFT_WHITE, TFT_NAVY);
-    tft.drawCentreString(buttons[i].label, tft.width() / 2, y + btnHeight / 2 - 10, 1);
-  }
-  tft.setTextColor(TFT_WHITE, TFT_BLACK);
-  tft.setFreeFont(&UbuntuMono_Regular8pt7b);
-  tft.drawCentreString("About...", tft.width() / 2, 215, 1);
+  int16_t hit = ui.hitTest(ev.startX, ev.startY);
+  if (hit < 0)
+    return;
+
+  currentPage = mainLayout[hit].arg; // Pages: 1 = WSPR, 2 = Calib, 3 = Manual, 4 = About
+  Serial.printf("Page changed to %d\n", currentPage);
 }
-void checkTouchMainMenuPage()
+
+
+void drawCalibrationPage()
 {
-  uint16_t x, y_raw;
-  if (tft.getTouch(&x, &y_raw))
-  {
-    int y = tft.height() - y_raw; // Flip Y axis if needed
+  ui.clear(TFT_BLACK);
+  sendRf(RfCommandType::CalibrationTone);
 
-    // ---- Main buttons area ----
-    const int btnWidth = 200;
-    const int btnHeight = 40;
-    const int spacingY = 11;
-    const int startY = 58;
+  // Header / instructions. The frequency is filled in by serviceRfStatus()
+  // once the RF task has tuned.
+  toneLabel = ui.addLabel(0, 18, tft.width(), 24, "CLK0 ...", &JetBrainsMono_Bold11pt7b, TFT_CYAN);
+  ui.addLabel(0, 48, tft.width(), 18, "Use freq counter or rig display", &UbuntuMono_Regular8pt7b, TFT_WHITE);
+  ui.addLabel(0, 68, tft.width(), 18, "to measure the actual frequency.", &UbuntuMono_Regular8pt7b, TFT_WHITE);
 
-    for (int i = 0; i < 3; i++)
-    {
-      int bx = (tft.width() - btnWidth) / 2;
-      int by = startY + i * (btnHeight + spacingY);
+  correctionReadout = ui.addReadout(0, 95, tft.width(), 30, "Correction: ", rfView.correctionPpb, " ppb", &JetBrainsMono_Bold11pt7b, TFT_GOLD);
+  drawCorrectionValue();
 
-      if (x >= bx && x <= bx + btnWidth &&
-          y >= by && y <= by + btnHeight)
-      {
-        currentPage = i + 1; // Pages: 1 = WSPR, 2 = Calib, 3 = Manual
-        Serial.printf("Page changed to %d\n", currentPage);
-        return;
-      }
-    }
+  // Correction steps, Auto and Return
+  for (size_t i = 0; i < LAYOUT_COUNT(calibrationLayout); i++)
+  {
+    const LayoutItem &item = calibrationLayout[i];
+    uint8_t id;
+    if (item.action == UiAction::Correct)
+      id = ui.addButton(item.x, item.y, item.w, item.h, 5, item.label, &JetBrainsMono_Bold11pt7b, TFT_WHITE, TFT_DARKGREY, 2);
+    else if (item.action == UiAction::AutoCal)
+      id = autoButton = ui.addButton(item.x, item.y, item.w, item.h, 6, item.label, &JetBrainsMono_Bold11pt7b, TFT_WHITE, TFT_DARKGREEN);
+    else
+      id = ui.addButton(item.x, item.y, item.w, item.h, 6, item.label, &JetBrainsMono_Bold11pt7b, TFT_WHITE, TFT_NAVY);
+    ui.setTouch(id, i);
+  }
+  drawAutoButton();
+}
+
+void drawCorrectionValue()
+{
+  if (lastPage != 2)
+    return;
+  ui.setValue(correctionReadout, rfView.autoCalRunning ? rfView.autoCalPpb : rfView.correctionPpb);
+  ui.setColors(correctionReadout, rfView.autoCalRunning ? TFT_ORANGE : TFT_GOLD, TFT_BLACK);
+}
 
-    // ---- About... label at bottom ----
-    const int aboutY = 215;       // Y position of "About..." label
-    const int aboutH = 16;        // Estimated height of text
-    const int textWidth = 160;    // Approximate clickable width
-    const int centerX = tft.width() / 2;
+void drawAutoButton()
+{
+  if (lastPage != 2)
+    return;
+  ui.setText(autoButton, rfView.autoCalRunning ? "Stop" : "Auto");
+  ui.setColors(autoButton, TFT_WHITE, rfView.autoCalRunning ? TFT_MAROON : TFT_DARKGREEN);
+}
 
-    if (x >= centerX - textWidth / 2 && x <= centerX + textWidth / 2 &&
-        y >= aboutY - 5 && y <= aboutY + aboutH + 5)
-    {
-      currentPage = 4; // About page
-      Serial.println("Navigating to About page");
-      delay(150);
-    }
+void startAutoCalibration()
+{
+  stopSweep();
+  stopWspr();
+  if (!freqCounter.begin())
+  {
+    Serial.println("Frequency counter unavailable");
+    return;
   }
+  Serial.printf("Auto calibration started (%s gate)\n", freqCounter.usesPps() ? "1PPS" : "long");
+  autoCal.start(correctionPpb);
+  publishRfStatus();
 }
 
+// Abandons a running calibration and goes back to the stored correction
+void stopAutoCalibration()
+{
+  if (!autoCal.isRunning())
+    return;
+  autoCal.abort();
+  freqCounter.end();
+  si5351.set_correction(correctionPpb, SI5351_PLL_INPUT_XO);
+  driftComp.setBaseCorrection(correctionPpb);
+  Serial.println("Auto calibration stopped");
+  publishRfStatus();
+}
 
-void drawCalibrationPage()
+// Feeds finished counter gates to the calibrator, called from the RF task
+void serviceAutoCalibration()
 {
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextDatum(MC_DATUM);
+  uint32_t counts, gateUs;
+  if (!autoCal.isRunning() || !freqCounter.poll(&counts, &gateUs))
+    return;
 
-  // Header / instructions
-  tft.setFreeFont(&JetBrainsMono_Bold11pt7b);
-  tft.setTextColor(TFT_CYAN, TFT_BLACK);
-  tft.drawCentreString("14.0 MHz on CLK0", tft.width() / 2, 20, 1);
-  tft.setFreeFont(&UbuntuMono_Regular8pt7b);
+  uint8_t steps = autoCal.steps();
+  AutoCalState state = autoCal.addGate(counts, gateUs);
+  if (state == AutoCalState::Done)
+  {
+    freqCounter.end();
+    // The result is a drift model point at today's temperature, entered
+    // relative to the old base before the base moves onto it
+    float tempC = crystalTemperature();
+    driftComp.addCalibrationPoint(tempC, autoCal.correction() - correctionPpb);
+    correctionPpb = autoCal.correction();
+    driftComp.rebaseCorrection(correctionPpb);
+    prefs.begin("si5351", false);
+    prefs.putInt("corr", correctionPpb);
+    prefs.end();
+    Serial.printf("Auto calibration done: %ld ppb at %.1f C (saved, %u drift points)\n",
+                  correctionPpb, tempC, driftComp.pointCount());
+  }
+  else if (state == AutoCalState::Failed)
+  {
+    freqCounter.end();
+    si5351.set_correction(correctionPpb, SI5351_PLL_INPUT_XO);
+    driftComp.setBaseCorrection(correctionPpb);
+    Serial.printf("Auto calibration failed, %u counts in %lu us\n", (unsigned)counts, (unsigned long)gateUs);
+  }
+
+  if (!autoCal.isRunning() || autoCal.steps() != steps)
+    publishRfStatus();
+}
+
+// Takes the monitor's events, called from the RF task. Only the event bits
+// are read here, the I2C polling stays on the monitor's task.
+void serviceStatusMonitor()
+{
+  uint8_t events = statusMon.takeEvents();
+  if (events & STATUSMON_LOL_A)
+    Serial.println("⚠️ Si5351 PLL A lost lock");
+  if (events & STATUSMON_LOL_B)
+    Serial.println("⚠️ Si5351 PLL B lost lock");
+  if (events & STATUSMON_SYS_INIT)
+  {
+    Serial.println("⚠️ Si5351 reset itself, reloading registers");
+    recoverSi5351();
+  }
+}
 
-  tft.setTextColor(TFT_WHITE, TFT_BLACK);
-  tft.drawCentreString("Use freq counter or rig display", tft.width() / 2, 50, 1);
-  tft.drawCentreString("to measure the actual frequency.", tft.width() / 2, 70, 1);
+// Redraws the lock health line when the monitor's picture changes, called
+// from the UI task. Status and counters are snapshots, safe from any task.
+void serviceLockStatus()
+{
+  static uint8_t shownStatus = 0;
+  static uint32_t shownLosses = 0;
+
+  StatusCounters c = statusMon.counters();
+  uint32_t losses = c.lolA + c.lolB + c.sysInit;
+  if (statusMon.status() != shownStatus || losses != shownLosses)
+    drawLockStatus();
+  shownStatus = statusMon.status();
+  shownLosses = losses;
+}
 
-  // Start output at 14 MHz
-  setCLK0freqMHz(14.0f); // Already defined
+// After a brown-out the Si5351 is back at its power-on defaults: rebuild
+// the register shadow and put the correction and CLK0 back
+void recoverSi5351()
+{
+  stopAutoCalibration();
+  stopSweep();
+  stopWspr();
+  if (!si5351CheckModule())
+  {
+    Serial.println("❌ Si5351 did not come back after reset");
+    return;
+  }
   si5351.set_correction(correctionPpb, SI5351_PLL_INPUT_XO);
+  driftComp.setBaseCorrection(correctionPpb);
+  resendCLK0();
+}
 
-  // Correction value display
-  tft.setFreeFont(&JetBrainsMono_Bold11pt7b);
-  tft.setTextColor(TFT_GOLD, TFT_BLACK);
-  String corrStr = formatWithSwissSeparator(correctionPpb);
-  String line = "Correction: " + corrStr + " ppb";
-  tft.drawCentreString(line, tft.width() / 2, 100, 1);
+// Sweeps CLK0 instead of holding a frequency. configure() sets up the PLL
+// and every step image here on the RF task, and the steps are written
+// here too, from serviceSweep(), so nothing else writes to the Si5351 at
+// the same time. CLK0 has no plan while sweeping; the next tune makes one.
+void startSweep(const RfCommand &cmd)
+{
+  stopSweep();
+  stopWspr();
+  stopAutoCalibration();
+  // A negative count is refused here, before it can wrap into a valid one
+  if (cmd.arg < 0 || !sweep.configure(cmd.freq, cmd.stopFreq, (uint32_t)cmd.arg, cmd.dwellUs) ||
+      !sweep.start(rfTaskHandle, cmd.repeat))
+  {
+    Serial.printf("❌ No sweep %s -> %s Hz in %ld steps of %lu us (2..%u steps, at least %lu us each)\n",
+                  formatCentiHz(cmd.freq).c_str(), formatCentiHz(cmd.stopFreq).c_str(), (long)cmd.arg,
+                  (unsigned long)cmd.dwellUs, SWEEP_MAX_STEPS, (unsigned long)SWEEP_MIN_DWELL_US);
+    // configure() may have got as far as the PLL
+    resendCLK0();
+    return;
+  }
+  clk0Plan = {};
+  publishRfStatus();
+}
 
-  // Correction buttons
-  const char *labels[6] = {"<<<", "<<", "<", ">", ">>", ">>>"};
-  const int values[6] = {-1000, -100, -10, +10, +100, +1000};
-  const int btnW = 48, btnH = 35, spacing = 5;
-  const int startX = (tft.width() - (6 * btnW + 5 * spacing)) / 2;
-  const int y = 140;
+void stopSweep()
+{
+  if (!sweep.isActive())
+    return;
+  sweep.stop();
+  publishRfStatus();
+}
 
-  tft.setFreeFont(&JetBrainsMono_Bold11pt7b);
+// Writes the sweep step the timer has made due, called from the RF task
+void serviceSweep()
+{
+  if (!sweep.isActive())
+    return;
+  sweep.service();
+  if (!sweep.isActive()) // A single sweep ran out, or the bus gave up
+    publishRfStatus();
+}
 
-  for (int i = 0; i < 6; i++)
+// Sends one WSPR message on a band, starting as soon as it is asked;
+// nothing here knows the time, so the user holds the band button from
+// the start of an even UTC minute. The PLL and the four tones are set
+// up here on the RF task, and the symbols are keyed here too, from
+// serviceWspr(). Like a sweep, it leaves CLK0 without a plan.
+void startWspr(int band)
+{
+  // Checked before prepare(), which retunes and mutes CLK0. The band
+  // page has already selected the band, so it gets its carrier instead
+  if (!wspr.hasMessage())
   {
-    int x = startX + i * (btnW + spacing);
-    tft.fillRoundRect(x, y, btnW, btnH, 5, TFT_DARKGREY);
-    tft.drawRoundRect(x, y, btnW, btnH, 5, TFT_WHITE);
-    tft.drawRoundRect(x + 1, y + 1, btnW - 2, btnH - 2, 5, TFT_WHITE);
-    tft.setTextColor(TFT_WHITE, TFT_DARKGREY);
-    tft.drawCentreString(labels[i], x + btnW / 2, y + btnH / 2 - 9, 1);
+    Serial.println("❌ WSPR disabled, no valid message set in WSPR_CALLSIGN/WSPR_LOCATOR");
+    stopSweep();
+    setCLK0band(band);
+    publishRfStatus();
+    return;
   }
-  // Draw return button
-  const int retBtnW = 120;
-  const int retBtnH = 34;
-  const int retX = (tft.width() - retBtnW) / 2;
-  const int retY = tft.height() - retBtnH - 10;
+  stopSweep();
+  stopWspr();
+  stopAutoCalibration();
+  if (!wspr.prepare(bands[band].frequencyHz) || !wspr.start(rfTaskHandle))
+  {
+    Serial.printf("❌ No WSPR transmission on %llu Hz\n", bands[band].frequencyHz);
+    resendCLK0();
+    return;
+  }
+  Serial.printf("📡 WSPR %s %s %d dBm, dial %llu Hz\n", WSPR_CALLSIGN, WSPR_LOCATOR, WSPR_POWER_DBM, bands[band].frequencyHz);
+  clk0Plan = {};
+  publishRfStatus();
+}
 
-  tft.fillRoundRect(retX, retY, retBtnW, retBtnH, 6, TFT_NAVY);
-  tft.drawRoundRect(retX, retY, retBtnW, retBtnH, 6, TFT_WHITE);
-  tft.setTextColor(TFT_WHITE, TFT_NAVY);
-  tft.setFreeFont(&JetBrainsMono_Bold11pt7b);
-  tft.drawCentreString("Return", tft.width() / 2, retY + retBtnH / 2 - 11, 1);
+void stopWspr()
+{
+  if (!wspr.isActive())
+    return;
+  wspr.stop();
+  publishRfStatus();
 }
 
-void checkTouchCalibrationPage()
+// Keys the symbol the timer has made due, called from the RF task
+void serviceWspr()
 {
-  uint16_t x, y_raw;
-  if (tft.getTouch(&x, &y_raw))
+  if (!wspr.isActive())
+    return;
+  wspr.service();
+  if (!wspr.isActive()) // All 162 symbols sent
   {
-    int y = tft.height() - y_raw; // Flip if needed
+    Serial.println("📡 WSPR message sent");
+    publishRfStatus();
+  }
+}
+
+// Temperature the drift model is keyed on. Nothing on this board sits
+// against the Si5351's crystal, so the ESP32's die sensor stands in: it
+// reads well above ambient and is noisy, but it follows the enclosure
+// warming up and cooling down, which is what the crystal follows too.
+// The model is fitted and looked up with the same source, so its offset
+// does not matter. A sensor next to the crystal would replace this
+// function. Filtered and sampled every TEMP_SAMPLE_MS, RF task only.
+float crystalTemperature()
+{
+  static float filtered = NAN;
+  static uint32_t lastSampleMs = 0;
+
+  if (isnan(filtered) || millis() - lastSampleMs >= TEMP_SAMPLE_MS)
+  {
+    float sample = temperatureRead();
+    filtered = isnan(filtered) ? sample : filtered + TEMP_SMOOTHING * (sample - filtered);
+    lastSampleMs = millis();
+  }
+  return filtered;
+}
+
+// A write the I2C task could not deliver leaves the Si5351 short of what
+// the driver's shadow says. The driver drops the shadow when it sees the
+// bus error count move; here the registers are read back and CLK0 and the
+// correction in effect are sent again. Called from the RF task.
+void serviceWriteErrors()
+{
+  static uint32_t seenErrors = 0;
+  static uint32_t lastResyncMs = 0;
+
+  // A sweep or WSPR rewrites CLK0 on its next step anyway; the rest waits for it to end
+  uint32_t errors = si5351Bus.error_count();
+  if (errors == seenErrors || millis() - lastResyncMs < RF_RESYNC_MS || sweep.isActive() || wspr.isActive())
+    return;
+  seenErrors = errors;
+  lastResyncMs = millis();
 
-    // --- Correction buttons ---
-    const int btnW = 48, btnH = 35, spacing = 5;
-    const int startX = (tft.width() - (6 * btnW + 5 * spacing)) / 2;
-    const int btnY = 140;
-    const int values[6] = {+1000, 100, +10, -10, -100, -1000};
+  Serial.printf("⚠️ Si5351 write failed (Wire status %u), resending registers\n", si5351Bus.last_error());
+  si5351.sync_shadow();
+  resendCLK0();
+}
+
+// Line based serial commands, read without waiting for a full line
+void serviceSerial()
+{
+  static char line[64];
+  static uint8_t len = 0;
 
-    for (int i = 0; i < 6; i++)
+  while (Serial.available() > 0)
+  {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n')
     {
-      int bx = startX + i * (btnW + spacing);
-      if (x >= bx && x <= bx + btnW &&
-          y >= btnY && y <= btnY + btnH)
+      if (len > 0)
       {
-        // Apply correction
-        correctionPpb += values[i];
-        si5351.set_correction(correctionPpb, SI5351_PLL_INPUT_XO);
-        // Save to flash
-        prefs.begin("si5351", false);
-        prefs.putInt("corr", correctionPpb);
-        prefs.end();
-
-        Serial.printf("Applied correction: %ld ppb (saved)\n", correctionPpb);
-
-        setCLK0freqMHz(14.0f);
-
-        // Redraw only the correction display
-        tft.fillRect(0, 95, tft.width(), 30, TFT_BLACK); // Clear area
-        tft.setFreeFont(&JetBrainsMono_Bold11pt7b);
-        tft.setTextColor(TFT_GOLD, TFT_BLACK);
-        String corrStr = formatWithSwissSeparator(correctionPpb);
-        String line = "Correction: " + corrStr + " ppb";
-        tft.drawCentreString(line, tft.width() / 2, 100, 1);
-        delay(150); // Basic debounce
-        return;
+        line[len] = '\0';
+        handleSerialCommand(line);
+        len = 0;
       }
     }
+    else if (len < sizeof(line) - 1)
+      line[len++] = c;
+  }
+}
 
-    // --- Return button ---
-    const int retBtnW = 120;
-    const int retBtnH = 34;
-    const int retX = (tft.width() - retBtnW) / 2;
-    const int retY = tft.height() - retBtnH - 10;
+void handleSerialCommand(char *line)
+{
+  if (strcmp(line, "status") == 0)
+  {
+    StatusCounters c = statusMon.counters();
+    Serial.printf("PLL A %s, PLL B %s, device %s\n", statusMon.locked(SI5351_PLLA) ? "locked" : "UNLOCKED",
+                  statusMon.locked(SI5351_PLLB) ? "locked" : "UNLOCKED",
+                  (statusMon.status() & STATUSMON_SYS_INIT) ? "initialising" : "ready");
+    Serial.printf("LOL A %lu, LOL B %lu, SYS_INIT %lu, polls %lu, read errors %lu, every %lu ms\n",
+                  (unsigned long)c.lolA, (unsigned long)c.lolB, (unsigned long)c.sysInit,
+                  (unsigned long)c.polls, (unsigned long)c.readErrors, (unsigned long)statusMon.period());
+  }
+  else if (strcmp(line, "status reset") == 0)
+  {
+    statusMon.resetCounters();
+    Serial.println("Status counters cleared");
+  }
+  else if (strncmp(line, "status rate ", 12) == 0)
+  {
+    statusMon.setPeriod(strtoul(line + 12, NULL, 10));
+    Serial.printf("Status polled every %lu ms\n", (unsigned long)statusMon.period());
+  }
+  else if (strcmp(line, "sweep stop") == 0)
+    sendRf(RfCommandType::StopSweep);
+  else if (strncmp(line, "sweep ", 6) == 0)
+  {
+    // sweep <start Hz> <stop Hz> <steps> <dwell us> [repeat]
+    char *p = line + 6;
+    RfCommand cmd = {};
+    cmd.type = RfCommandType::StartSweep;
+    cmd.freq = strtoull(p, &p, 10) * SI5351_FREQ_MULT;
+    cmd.stopFreq = strtoull(p, &p, 10) * SI5351_FREQ_MULT;
+    cmd.arg = strtol(p, &p, 10);
+    cmd.dwellUs = strtoul(p, &p, 10);
+    cmd.repeat = strstr(p, "repeat") != nullptr;
+    sendRf(cmd);
+  }
+  else
+    Serial.println("Commands: status | status reset | status rate <ms> | sweep <start Hz> <stop Hz> <steps> <dwell us> [repeat] | sweep stop");
+}
 
-    if (x >= retX && x <= retX + retBtnW &&
-        y >= retY && y <= retY + retBtnH)
-    {
-      currentPage = 0;
-      Serial.println("Returning to main menu");
-      delay(200); // Debounce
-    }
+// Steps apply on press and again while held; the result is saved once,
+// on release, instead of on every repeat
+void checkTouchCalibrationPage(const TouchEvent &ev)
+{
+  static bool unsaved = false;
+
+  if (ev.type == TouchEventType::Release && unsaved)
+  {
+    unsaved = false;
+    sendRf(RfCommandType::SaveCorrection);
+    return;
+  }
+  if (ev.type != TouchEventType::Press && ev.type != TouchEventType::Repeat)
+    return;
+
+  int16_t hit = ui.hitTest(ev.startX, ev.startY);
+  if (hit < 0)
+    return;
+
+  const LayoutItem &item = calibrationLayout[hit];
+  switch (item.action)
+  {
+  case UiAction::Correct:
+    if (rfView.autoCalRunning)
+      return;
+    // The readout follows once the RF task has applied it
+    if (sendRf(RfCommandType::StepCorrection, item.arg))
+      unsaved = true;
+    break;
+
+  case UiAction::Return:
+    if (ev.type != TouchEventType::Press)
+      return;
+    sendRf(RfCommandType::StopAutoCal);
+    currentPage = 0;
+    Serial.println("Returning to main menu");
+    break;
+
+  case UiAction::AutoCal:
+    if (ev.type != TouchEventType::Press)
+      return;
+    sendRf(rfView.autoCalRunning ? RfCommandType::StopAutoCal : RfCommandType::StartAutoCal);
+    break;
+
+  default:
+    break;
   }
 }
 
-String formatWithSwissSeparator(int32_t value)
+String formatWithSwissSeparator(int64_t value)
 {
-  char temp[20];
-  sprintf(temp, "%ld", value);
+  char temp[24];
+  sprintf(temp, "%lld", value);
 
   String str = temp;
   String out = "";
@@ -570,137 +1229,120 @@ String formatWithSwissSeparator(int32_t value)
 
 void drawFrequencyEntryPage()
 {
-  tft.fillScreen(TFT_NAVY);
-  tft.setTextDatum(MC_DATUM);
-  tft.setFreeFont(&JetBrainsMono_Bold15pt7b);
-
-  // Calculator-style display boxfillRect
-  tft.drawRoundRect(35, 4, 250, 40, 6, TFT_WHITE);
-  tft.fillRoundRect(36, 5, 248, 38, 6, TFT_BLACK);
-  tft.setTextColor(TFT_YELLOW, TFT_BLACK);
-  // Format frequency with Swiss-style thousand separator
-  uint64_t freq = frequencyInputStr.toInt();
-  String formattedFreq = formatWithSwissSeparator(freq);
-  tft.drawCentreString(formattedFreq + " Hz", tft.width() / 2, 8, 1);
+  ui.clear(TFT_NAVY);
 
-  // Keypad layout
-  const char *keys[12] = {"1", "2", "3", "4", "5", "6", "7", "8", "9", "C", "0", "OK"};
-  int btnW = 77, btnH = 40, spacingX = 10, spacingY = 10;
-  int startX = (tft.width() - (3 * btnW + 2 * spacingX)) / 2;
-  int startY = 50;
+  // Calculator-style display with Swiss-style thousand separators
+  entryDisplay = ui.addReadout(35, 4, 250, 40, "", frequencyInputHz, " Hz", &JetBrainsMono_Bold15pt7b, TFT_YELLOW);
+  ui.setFrame(entryDisplay, TFT_WHITE, TFT_BLACK, 6, 1);
+  entryErrorMs = 0;
 
-  tft.setFreeFont(&JetBrainsMono_Bold11pt7b);
-  for (int i = 0; i < 12; i++)
+  // Keypad
+  for (size_t i = 0; i < LAYOUT_COUNT(keypadLayout); i++)
   {
-    int col = i % 3;
-    int row = i / 3;
-    int x = startX + col * (btnW + spacingX);
-    int y = startY + row * (btnH + spacingY);
-
-    tft.fillRoundRect(x, y, btnW, btnH, 5, TFT_DARKGREY);
-    tft.drawRoundRect(x, y, btnW, btnH, 5, TFT_WHITE);
-    tft.setTextColor(TFT_WHITE, TFT_DARKGREY);
-    tft.drawCentreString(keys[i], x + btnW / 2, y + btnH / 2 - 9, 1);
+    const LayoutItem &key = keypadLayout[i];
+    ui.setTouch(ui.addButton(key.x, key.y, key.w, key.h, 5, key.label, &JetBrainsMono_Bold11pt7b, TFT_WHITE, TFT_DARKGREY), i);
   }
 }
 
-void checkTouchFrequencyEntryPage()
+// Keys act on press, except OK: a tap tunes to the entry, holding it
+// sweeps from the current CLK0 frequency to the entry
+void checkTouchFrequencyEntryPage(const TouchEvent &ev)
 {
-  uint16_t x, y_raw;
-  if (!tft.getTouch(&x, &y_raw))
+  if (ev.type == TouchEventType::LongPress || (ev.type == TouchEventType::Release && ev.tap))
+  {
+    int16_t hit = ui.hitTest(ev.startX, ev.startY);
+    if (hit >= 0 && keypadLayout[hit].arg == 'K')
+      enterFrequency(ev.type == TouchEventType::LongPress);
+    return;
+  }
+  if (ev.type != TouchEventType::Press)
     return;
 
-  int y = tft.height() - y_raw;
-
-  const int btnW = 77, btnH = 40, spacingX = 10, spacingY = 10;
-  const int startX = (tft.width() - (3 * btnW + 2 * spacingX)) / 2;
-  const int startY = 50;
+  int16_t hit = ui.hitTest(ev.startX, ev.startY);
+  if (hit < 0)
+    return;
 
-  const char *keys[12] = {"1", "2", "3", "4", "5", "6", "7", "8", "9", "C", "0", "OK"};
+  char key = keypadLayout[hit].arg;
+  entryErrorMs = 0; // Any key takes an error message down
 
-  for (int i = 0; i < 12; i++)
+  if (key == 'C')
   {
-    int col = i % 3;
-    int row = i / 3;
-    int bx = startX + col * (btnW + spacingX);
-    int by = startY + row * (btnH + spacingY);
-
-    if (x >= bx && x <= bx + btnW && y >= by && y <= by + btnH)
-    {
-      const char *key = keys[i];
+    frequencyInputHz = 0;
+  }
+  else if (key == 'K')
+  {
+    return; // On release or hold
+  }
+  else
+  {
+    // Digits accumulate straight into Hz, up to ten of them
+    if (frequencyInputHz < 1000000000ULL)
+      frequencyInputHz = frequencyInputHz * 10 + (key - '0');
+  }
 
-      if (strcmp(key, "C") == 0)
-      {
-        frequencyInputStr = "0";
-      }
-      else if (strcmp(key, "OK") == 0)
-      {
-        if (frequencyInputStr.length() > 0)
-        {
-          uint64_t freqHz = strtoull(frequencyInputStr.c_str(), NULL, 10);
-
-          if (freqHz >= 8000 && freqHz <= 160000000)
-          {
-            float freqMHz = freqHz / 1000000.0f;
-            Serial.printf("✅ Setting CLK0 to %llu Hz (%.6f MHz)\n", freqHz, freqMHz);
-            setCLK0freqMHz(freqMHz);
-            currentPage = 0; // Return to main
-            return;
-          }
-          else
-          {
-            Serial.printf("❌ Invalid frequency entered: %llu Hz\n", freqHz);
-
-            // Show error in red
-            tft.fillRoundRect(36, 5, 248, 38, 6, TFT_BLACK);
-            tft.setTextColor(TFT_RED, TFT_BLACK);
-            tft.setFreeFont(&JetBrainsMono_Bold15pt7b);
-            tft.setTextDatum(MC_DATUM);
-            tft.drawCentreString("Out of range!", tft.width() / 2, 8, 1);
-
-            delay(2000); // Wait 2 seconds
-
-            // Reset to "0"
-            frequencyInputStr = "0";
-          }
-        }
-      }
-      else
-      {
-        if (frequencyInputStr == "0")
-          frequencyInputStr = ""; // prevent leading zero
-        if (frequencyInputStr.length() < 10)
-          frequencyInputStr += key;
-      }
+  showFrequencyInput();
+}
 
-      // Redraw frequency display
-      tft.fillRoundRect(36, 5, 248, 38, 6, TFT_BLACK);
-      tft.setTextColor(TFT_YELLOW, TFT_BLACK);
-      tft.setFreeFont(&JetBrainsMono_Bold15pt7b);
-      tft.setTextDatum(MC_DATUM);
-      uint64_t freq = strtoull(frequencyInputStr.c_str(), NULL, 10);
-      String formattedFreq = formatWithSwissSeparator(freq);
-      tft.drawCentreString(formattedFreq + " Hz", tft.width() / 2, 8, 1);
+void enterFrequency(bool sweepTo)
+{
+  uint64_t freqHz = frequencyInputHz;
 
-      delay(150); // Basic debounce
-      return;
+  if (freqHz >= 8000 && freqHz <= 160000000)
+  {
+    if (sweepTo && rfView.clk0Freq != 0)
+    {
+      Serial.printf("✅ Sweeping CLK0 from %s to %llu Hz, tune to stop\n", formatCentiHz(rfView.clk0Freq).c_str(), freqHz);
+      RfCommand cmd = {RfCommandType::StartSweep, ENTRY_SWEEP_STEPS, rfView.clk0Freq, freqHz * SI5351_FREQ_MULT, ENTRY_SWEEP_DWELL_US, true};
+      sendRf(cmd);
     }
+    else
+    {
+      Serial.printf("✅ Setting CLK0 to %llu Hz\n", freqHz);
+      sendRf(RfCommandType::TuneFrequency, 0, freqHz * SI5351_FREQ_MULT);
+    }
+    currentPage = 0; // Return to main
+    return;
   }
+
+  Serial.printf("❌ Invalid frequency entered: %llu Hz\n", freqHz);
+
+  // Show error in red for 2 seconds, serviceEntryError() puts the
+  // cleared input back
+  frequencyInputHz = 0;
+  ui.setText(entryDisplay, "Out of range!");
+  ui.setColors(entryDisplay, TFT_RED, TFT_BLACK);
+  entryErrorMs = millis() | 1; // Never 0, that means no error
+}
+
+// Only the display changes
+void showFrequencyInput()
+{
+  ui.setValue(entryDisplay, frequencyInputHz);
+  ui.setColors(entryDisplay, TFT_YELLOW, TFT_BLACK);
+}
+
+// Takes the range error down again, called from the UI task
+void serviceEntryError()
+{
+  if (entryErrorMs == 0 || millis() - entryErrorMs < 2000)
+    return;
+  entryErrorMs = 0;
+  if (lastPage == 3)
+    showFrequencyInput();
 }
 
 void drawAboutPage()
 {
+ ui.release();
  displayQRcodeScreen();
   
 }
 
-void checkTouchAboutPage()
+void checkTouchAboutPage(const TouchEvent &ev)
 {
-  uint16_t x, y_raw;
-  if (tft.getTouch(&x, &y_raw))
+  if (ev.type == TouchEventType::Press)
   {
     Serial.println("Touch detected on About page, returning to main");
     currentPage = 0;
-    delay(200);
   }
 }
@@ -0,0 +1,260 @@
+#include "wspr.h"
+
+// Sync vector shared by every WSPR transmission (LSB of each symbol)
+static const uint8_t wsprSync[WSPR_SYMBOL_COUNT] = {
+    1, 1, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 1, 1, 0, 0, 0, 1, 0,
+    0, 1, 0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 1,
+    0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 0, 1,
+    1, 0, 1, 0, 0, 0, 0, 1, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 0, 1,
+    0, 0, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0, 1, 0, 1, 0, 0, 0, 1, 0,
+    0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 1, 1, 0, 1, 1, 0, 0, 1, 1,
+    0, 1, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0,
+    0, 0};
+
+// Convolutional code polynomials, K = 32, r = 1/2
+#define WSPR_POLY1 0xF2D05351UL
+#define WSPR_POLY2 0xE4613C47UL
+
+WSPRTransmitter *WSPRTransmitter::instance = nullptr;
+
+static int wsprCharValue(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A' + 10;
+  if (c == ' ')
+    return 36;
+  return -1;
+}
+
+bool wsprEncode(const char *callsign, const char *locator, int8_t powerDbm, uint8_t *symbols)
+{
+  // Callsign: 6 characters with the digit in position 3 (index 2)
+  char call[7] = "      ";
+  size_t len = strlen(callsign);
+  if (len == 0 || len > 6)
+    return false;
+
+  int offset = (len >= 2 && isdigit((unsigned char)callsign[1]) && !isdigit((unsigned char)callsign[2])) ? 1 : 0;
+  if (len + offset > 6)
+    return false;
+  for (size_t i = 0; i < len; i++)
+    call[i + offset] = toupper((unsigned char)callsign[i]);
+
+  if (!isdigit((unsigned char)call[2]))
+    return false;
+
+  int v[6];
+  for (int i = 0; i < 6; i++)
+  {
+    v[i] = wsprCharValue(call[i]);
+    if (v[i] < 0)
+      return false;
+  }
+  // Last three positions are letters or space only
+  for (int i = 3; i < 6; i++)
+  {
+    if (v[i] < 10)
+      return false;
+  }
+
+  uint32_t n = v[0];
+  n = n * 36 + v[1];
+  n = n * 10 + v[2];
+  n = n * 27 + (v[3] - 10);
+  n = n * 27 + (v[4] - 10);
+  n = n * 27 + (v[5] - 10);
+
+  // Locator: 4-character Maidenhead square
+  if (strlen(locator) < 4)
+    return false;
+  char loc[4];
+  for (int i = 0; i < 4; i++)
+    loc[i] = toupper((unsigned char)locator[i]);
+  if (loc[0] < 'A' || loc[0] > 'R' || loc[1] < 'A' || loc[1] > 'R' ||
+      !isdigit((unsigned char)loc[2]) || !isdigit((unsigned char)loc[3]))
+    return false;
+
+  // Power: 0..60 dBm, snapped to the nearest value ending in 0, 3 or 7
+  if (powerDbm < 0)
+    powerDbm = 0;
+  if (powerDbm > 60)
+    powerDbm = 60;
+  static const uint8_t powerSteps[] = {0, 3, 3, 3, 7, 7, 7, 7, 10, 10};
+  powerDbm = (powerDbm / 10) * 10 + powerSteps[powerDbm % 10];
+
+  uint32_t m = (179 - 10 * (loc[0] - 'A') - (loc[2] - '0')) * 180 + 10 * (loc[1] - 'A') + (loc[3] - '0');
+  m = m * 128 + powerDbm + 64;
+
+  // 28 + 22 = 50 message bits, MSB first
+  uint8_t packed[11] = {0};
+  packed[0] = (n >> 20) & 0xFF;
+  packed[1] = (n >> 12) & 0xFF;
+  packed[2] = (n >> 4) & 0xFF;
+  packed[3] = ((n & 0x0F) << 4) | ((m >> 18) & 0x0F);
+  packed[4] = (m >> 10) & 0xFF;
+  packed[5] = (m >> 2) & 0xFF;
+  packed[6] = (m & 0x03) << 6;
+
+  // Convolutional encoding of the 50 bits plus 31 zero tail bits
+  uint8_t coded[WSPR_SYMBOL_COUNT];
+  uint32_t reg = 0;
+  int k = 0;
+  for (int bit = 0; bit < 81; bit++)
+  {
+    reg = (reg << 1) | ((packed[bit / 8] >> (7 - bit % 8)) & 0x01);
+    coded[k++] = __builtin_parityl(reg & WSPR_POLY1);
+    coded[k++] = __builtin_parityl(reg & WSPR_POLY2);
+  }
+
+  // Interleave by bit-reversed address, then merge with the sync vector
+  uint8_t interleaved[WSPR_SYMBOL_COUNT];
+  k = 0;
+  for (int i = 0; i < 256 && k < WSPR_SYMBOL_COUNT; i++)
+  {
+    uint8_t r = 0;
+    for (int b = 0; b < 8; b++)
+      r |= ((i >> b) & 0x01) << (7 - b);
+    if (r < WSPR_SYMBOL_COUNT)
+      interleaved[r] = coded[k++];
+  }
+
+  for (int i = 0; i < WSPR_SYMBOL_COUNT; i++)
+    symbols[i] = wsprSync[i] + 2 * interleaved[i];
+
+  return true;
+}
+
+WSPRTransmitter::WSPRTransmitter(Si5351 &synth, enum si5351_clock clk)
+    : si5351(synth), clock(clk)
+{
+}
+
+bool WSPRTransmitter::setMessage(const char *callsign, const char *locator, int8_t powerDbm)
+{
+  if (active)
+    return false;
+
+  messageReady = wsprEncode(callsign, locator, powerDbm, symbolTable);
+  return messageReady;
+}
+
+bool WSPRTransmitter::prepare(uint64_t dialFreqHz, uint16_t audioOffsetHz)
+{
+  if (active)
+    return false;
+
+  // Tone 0 at dial + offset; the PLL is set once here and never touched while keying
+  uint64_t baseFreq = (dialFreqHz + audioOffsetHz) * SI5351_FREQ_MULT;
+  tonesReady = false;
+
+  if (si5351.set_freq(baseFreq, clock) != 0)
+    return false;
+  si5351.output_enable(clock, 0);
+
+  for (int tone = 0; tone < WSPR_TONE_COUNT; tone++)
+  {
+    uint64_t toneFreq = baseFreq + ((uint64_t)tone * WSPR_TONE_SPACING_CHZ_NUM + WSPR_TONE_SPACING_CHZ_DEN / 2) / WSPR_TONE_SPACING_CHZ_DEN;
+    int64_t errorUHz;
+
+    if (si5351.calc_ms_image(toneFreq, si5351.pll_assignment[clock], toneImage[tone], &errorUHz) != 0)
+      return false;
+
+    Serial.printf("WSPR tone %d: %llu.%02llu Hz (error %lld uHz)\n", tone,
+                  toneFreq / SI5351_FREQ_MULT, toneFreq % SI5351_FREQ_MULT, errorUHz);
+  }
+
+  tonesReady = true;
+  return true;
+}
+
+bool WSPRTransmitter::start(TaskHandle_t owner)
+{
+  if (active || !messageReady || !tonesReady || owner == nullptr)
+    return false;
+
+  instance = this;
+  ownerTask = owner;
+
+  if (timer == nullptr)
+  {
+    timer = timerBegin(WSPR_TIMER_NUM, 80, true); // 1 us ticks
+    timerAttachInterrupt(timer, &onSymbolTimer, true);
+  }
+
+  // Key the first symbol now, the timer paces the remaining 161 edges
+  ticks = 0;
+  ticksServed = 0;
+  missed = 0;
+  failed = 0;
+  keySymbol(0);
+  active = true;
+  si5351.output_enable(clock, 1);
+
+  timerWrite(timer, 0);
+  timerAlarmWrite(timer, WSPR_SYMBOL_PERIOD_US, true);
+  timerAlarmEnable(timer);
+
+  return true;
+}
+
+void WSPRTransmitter::stop()
+{
+  if (timer != nullptr)
+    timerAlarmDisable(timer);
+
+  if (active)
+  {
+    active = false;
+    si5351.output_enable(clock, 0);
+    if (missed != 0 || failed != 0)
+      Serial.printf("WSPR: %u symbols late, %u writes failed\n", missed, failed);
+  }
+}
+
+// Keys the symbol that is due. Called by the owner task each time it
+// wakes; returns true when a symbol went out.
+bool WSPRTransmitter::service()
+{
+  if (!active)
+    return false;
+
+  uint8_t due = ticks;
+  if (due == ticksServed)
+    return false;
+  missed += due - ticksServed - 1;
+  ticksServed = due;
+
+  // The last symbol has had its full period
+  if (due >= WSPR_SYMBOL_COUNT)
+  {
+    stop();
+    return false;
+  }
+  keySymbol(due);
+  return true;
+}
+
+// The interrupt does no I2C, it only counts the edge and wakes the owner
+void IRAM_ATTR WSPRTransmitter::onSymbolTimer()
+{
+  BaseType_t woken = pdFALSE;
+  if (instance != nullptr && instance->active)
+  {
+    instance->ticks = instance->ticks + 1;
+    vTaskNotifyGiveFromISR(instance->ownerTask, &woken);
+  }
+  portYIELD_FROM_ISR(woken);
+}
+
+void WSPRTransmitter::keySymbol(uint8_t index)
+{
+  // One bulk write; the register shadow trims it to the bytes that differ.
+  // A failed write drops the shadow, so the next symbol sends all 8 bytes.
+  symbol = index;
+  uint8_t tone = symbolTable[index];
+  if (si5351.si5351_write_bulk(SI5351_CLK0_PARAMETERS + (clock * 8), SI5351_PARAMETERS_LENGTH, toneImage[tone]) != 0)
+    failed++;
+}